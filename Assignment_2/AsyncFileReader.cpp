@@ -0,0 +1,356 @@
+#include "AsyncFileReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+using namespace std;
+
+// Times a submission the kernel refuses for lack of resources is retried while no read is in flight
+static const unsigned MAX_IDLE_RETRIES = 64;
+
+AsyncFileReader::AsyncFileReader()
+    : blockSize(0), headroom(0), nextOffset(0), handedOut(0), ringFd(-1), queued(0), inFlight(0),
+      sqRing(NULL), cqRing(NULL), sqes(NULL), sqRingSize(0), cqRingSize(0), sqesSize(0),
+      sqTail(NULL), sqMask(NULL), sqArray(NULL), cqHead(NULL), cqTail(NULL), cqMask(NULL), cqes(NULL) {}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    close();
+}
+
+bool AsyncFileReader::open(const string &filename, size_t blockSize, unsigned depth, size_t headroom)
+{
+    close();
+    if (!file.open(filename))
+    {
+        return false;
+    }
+
+    this->blockSize = max(blockSize, (size_t)1);
+    this->headroom = headroom;
+    nextOffset = 0;
+    handedOut = 0;
+    slots.assign(max(depth, 1u), Slot());
+
+    // Without io_uring, next() reads each block itself
+    if (depth == 0 || !setupRing(depth))
+    {
+        return true;
+    }
+    for (Slot &slot : slots)
+    {
+        if (nextOffset < file.size())
+        {
+            startBlock(slot, nextOffset);
+        }
+    }
+    if (!enterRing(false))
+    {
+        fallBackToPread();
+    }
+    return true;
+}
+
+bool AsyncFileReader::next(string &block)
+{
+    if (handedOut >= file.size())
+    {
+        return false;
+    }
+
+    Slot &slot = slots[(handedOut / blockSize) % slots.size()];
+    while (ringFd >= 0 && !slot.done)
+    {
+        if (!enterRing(true))
+        {
+            fallBackToPread();
+        }
+    }
+    if (ringFd < 0)
+    {
+        slot.offset = handedOut;
+        slot.want = min(blockSize, file.size() - handedOut);
+        slot.filled = 0;
+        slot.buffer.resize(headroom + slot.want);
+    }
+
+    // Whatever io_uring did not deliver (an error, or no io_uring at all) is read with pread
+    if (slot.filled < slot.want)
+    {
+        slot.filled += file.readAt(&slot.buffer[headroom + slot.filled], slot.want - slot.filled, slot.offset + slot.filled);
+    }
+    if (slot.filled == 0)
+    {
+        return false; // The file is shorter than when it was opened
+    }
+
+    slot.buffer.resize(headroom + slot.filled);
+    block.swap(slot.buffer);
+    handedOut += slot.want;
+
+    // The slot is free again: start on the block after the ones already in flight
+    if (ringFd >= 0 && nextOffset < file.size())
+    {
+        startBlock(slot, nextOffset);
+        if (!enterRing(false))
+        {
+            fallBackToPread();
+        }
+    }
+    return true;
+}
+
+void AsyncFileReader::close()
+{
+    // The kernel may still write into the buffers of reads in flight
+    while (ringFd >= 0 && inFlight > 0)
+    {
+        if (!enterRing(true))
+        {
+            fallBackToPread();
+        }
+    }
+    closeRing();
+    queued = 0;
+    slots.clear();
+    abandoned.clear();
+    file.close();
+}
+
+// Starts reading the block at offset into a fresh buffer of the slot
+void AsyncFileReader::startBlock(Slot &slot, size_t offset)
+{
+    slot.offset = offset;
+    slot.want = min(blockSize, file.size() - offset);
+    slot.filled = 0;
+    slot.buffer.clear();
+    slot.buffer.resize(headroom + slot.want);
+    nextOffset = offset + slot.want;
+    queueRead(slot);
+}
+
+// Queues a read of the rest of the slot's block; enterRing submits it
+void AsyncFileReader::queueRead(Slot &slot)
+{
+#ifdef HAVE_IO_URING
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe *sqe = (io_uring_sqe *)sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+
+    slot.iov.iov_base = &slot.buffer[headroom + slot.filled];
+    slot.iov.iov_len = slot.want - slot.filled;
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = file.descriptor();
+    sqe->addr = (uint64_t)(uintptr_t)&slot.iov;
+    sqe->len = 1;
+    sqe->off = slot.offset + slot.filled;
+    sqe->user_data = &slot - &slots[0];
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    slot.done = false;
+    queued++;
+#endif
+}
+
+// Submits the queued reads and, with wait set, blocks until at least one read completes; then
+// handles every completion that has arrived. Only the reads the kernel accepted count as in flight,
+// the rest stay queued for the next call. Returns false on an error that retrying will not fix.
+bool AsyncFileReader::enterRing(bool wait)
+{
+#ifdef HAVE_IO_URING
+    unsigned submit = queued;
+    unsigned idleRetries = 0;
+    while (true)
+    {
+        int result = syscall(__NR_io_uring_enter, ringFd, submit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (result >= 0)
+        {
+            queued -= result;
+            inFlight += result;
+            if (result > 0 || submit == 0)
+            {
+                break;
+            }
+            errno = EAGAIN; // The kernel took none of the reads: as short of resources as EAGAIN
+        }
+        else if (errno == EINTR)
+        {
+            continue;
+        }
+        else if (errno != EAGAIN && errno != EBUSY)
+        {
+            return false;
+        }
+
+        // Out of resources for new requests, or the completion ring is full: wait for a read in
+        // flight to finish and make room before submitting again. With none in flight, retry a
+        // few times in case the shortage is passing.
+        if (inFlight == 0)
+        {
+            if (++idleRetries > MAX_IDLE_RETRIES)
+            {
+                return false;
+            }
+            sched_yield();
+            continue;
+        }
+        reapCompletions();
+        submit = 0;
+        wait = true;
+    }
+    reapCompletions();
+    return true;
+#else
+    (void)wait;
+    return false;
+#endif
+}
+
+// Handles the completions in the ring without blocking, updating their slots
+void AsyncFileReader::reapCompletions()
+{
+#ifdef HAVE_IO_URING
+    unsigned head = *cqHead;
+    while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+    {
+        const io_uring_cqe &cqe = ((const io_uring_cqe *)cqes)[head & *cqMask];
+        Slot &slot = slots[cqe.user_data];
+        int result = cqe.res;
+        __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+        inFlight--;
+
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            queueRead(slot);
+            continue;
+        }
+        if (result > 0)
+        {
+            slot.filled += result;
+            if (slot.filled < slot.want)
+            {
+                queueRead(slot); // Short read: ask for the rest
+                continue;
+            }
+        }
+
+        // Complete, at the end of the file, or failed; next() reads whatever is missing with pread
+        slot.done = true;
+    }
+#endif
+}
+
+// Gives up on io_uring after an error that retrying will not fix; next() then reads every block
+// with pread. Reads still in flight are waited for while the ring answers, and the buffers of any
+// that are not are set aside until close, so a late completion never lands in a block handed out.
+void AsyncFileReader::fallBackToPread()
+{
+    cerr << "io_uring failed (" << strerror(errno) << "), reading with pread" << endl;
+    while (inFlight > 0 && enterRing(true))
+    {
+    }
+    for (Slot &slot : slots)
+    {
+        if (!slot.done)
+        {
+            abandoned.push_back(string());
+            abandoned.back().swap(slot.buffer);
+            slot.done = true;
+        }
+    }
+    closeRing();
+    queued = 0;
+    inFlight = 0;
+}
+
+// Creates an io_uring instance and maps its rings; false if the kernel does not allow it
+bool AsyncFileReader::setupRing(unsigned entries)
+{
+#ifdef HAVE_IO_URING
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+    {
+        return false;
+    }
+    ringFd = fd;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap)
+    {
+        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+    {
+        sqRing = NULL;
+        closeRing();
+        return false;
+    }
+    cqRing = singleMap ? sqRing : mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (cqRing == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        cqRing = (cqRing == MAP_FAILED) ? NULL : cqRing;
+        sqes = (sqes == MAP_FAILED) ? NULL : sqes;
+        closeRing();
+        return false;
+    }
+
+    char *sq = (char *)sqRing;
+    char *cq = (char *)cqRing;
+    sqTail = (unsigned *)(sq + params.sq_off.tail);
+    sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    sqArray = (unsigned *)(sq + params.sq_off.array);
+    cqHead = (unsigned *)(cq + params.cq_off.head);
+    cqTail = (unsigned *)(cq + params.cq_off.tail);
+    cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+    return true;
+#else
+    (void)entries;
+    return false;
+#endif
+}
+
+void AsyncFileReader::closeRing()
+{
+    if (sqes != NULL)
+    {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != NULL && cqRing != sqRing)
+    {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != NULL)
+    {
+        munmap(sqRing, sqRingSize);
+    }
+    sqRing = cqRing = sqes = NULL;
+
+    if (ringFd >= 0)
+    {
+        ::close(ringFd);
+        ringFd = -1;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef ASYNC_FILE_READER_H
+#define ASYNC_FILE_READER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include "PreadFile.h"
+
+using namespace std;
+
+// Reads a file front to back in large blocks while keeping several reads in
+// flight, so a cold page cache costs one disk latency per batch of blocks
+// instead of one per block. Reads go through io_uring when the kernel offers
+// it (set up with raw system calls, no liburing needed) and otherwise through
+// plain synchronous pread calls. Blocks are handed out in file order; each one
+// is a buffer of its own that the caller keeps.
+class AsyncFileReader
+{
+public:
+    AsyncFileReader();
+
+    // Waits for reads still in flight and closes the file
+    ~AsyncFileReader();
+
+    /**
+     * Opens the file and starts the first reads.
+     * @param filename - name of data file
+     * @param blockSize - bytes per block
+     * @param depth - blocks read ahead; 0 reads each block with pread when it is asked for
+     * @param headroom - bytes left free in front of the data of every block
+     * @retval true if the file was opened and is not empty, false otherwise
+     */
+    bool open(const string &filename, size_t blockSize, unsigned depth, size_t headroom);
+
+    /**
+     * Waits for the next block in file order and swaps it into block: headroom
+     * bytes, then the data.
+     * @retval false once the whole file has been handed out
+     */
+    bool next(string &block);
+
+    /**
+     * Waits for reads still in flight and closes the file.
+     */
+    void close();
+
+    // True while the reads go through io_uring rather than pread
+    bool usesIoUring() const { return ringFd >= 0; }
+
+private:
+    // One block being read: block i of the file uses slots[i % slots.size()]
+    struct Slot
+    {
+        string buffer;    // headroom bytes, then the block
+        struct iovec iov; // Part of the block still to read, while a read is queued
+        size_t offset;    // Position of the block in the file
+        size_t want;      // Bytes in the block
+        size_t filled;    // Bytes read so far
+        bool done;        // No read of this block is in flight
+    };
+
+    AsyncFileReader(const AsyncFileReader &) = delete;
+    AsyncFileReader &operator=(const AsyncFileReader &) = delete;
+
+    bool setupRing(unsigned entries);
+    void closeRing();
+    void startBlock(Slot &slot, size_t offset);
+    void queueRead(Slot &slot);
+    bool enterRing(bool wait);
+    void reapCompletions();
+    void fallBackToPread();
+
+    PreadFile file;
+    size_t blockSize;
+    size_t headroom;
+    size_t nextOffset;  // Position of the next block to start reading
+    size_t handedOut;   // Bytes of the file handed out so far
+    vector<Slot> slots;
+    vector<string> abandoned; // Buffers of reads lost with a failed ring, kept until close
+
+    // io_uring submission and completion rings, shared with the kernel
+    int ringFd;
+    unsigned queued;   // Reads in the submission ring that the kernel has not accepted yet
+    unsigned inFlight; // Reads the kernel accepted that have not completed
+    void *sqRing, *cqRing, *sqes;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    void *cqes;
+};
+
+#endif // ASYNC_FILE_READER_H
@@ -0,0 +1,89 @@
+#ifndef HOURLY_STORE_H
+#define HOURLY_STORE_H
+
+#include <algorithm>
+#include <vector>
+#include "LogParser.h"
+
+using namespace std;
+
+/**
+ * Dense per-hour storage. Hours are numbered arithmetically (hours since
+ * 2000-01-01 00:00, see hourIndex) and a bucket lives at
+ * buckets[hour - firstHour()], so a lookup is a subtraction instead of a walk
+ * down a tree, buckets sit next to each other in memory in calendar order, and
+ * no node is allocated per hour. The covered range grows in either direction
+ * as new hours are touched; hours inside the range that never received a
+ * reading keep a default constructed bucket.
+ */
+template <typename Bucket>
+class HourlyStore
+{
+public:
+    HourlyStore() : base(0) {}
+
+    /**
+     * Number of the hour a reading falls in.
+     * @arg year - two digit year as read from the log
+     */
+    static int hourIndex(int year, int month, int day, int hour)
+    {
+        return logDaysFromCivil(year, month, day) * 24 + hour;
+    }
+
+    /**
+     * Inverse of hourIndex.
+     */
+    static void hourFields(int index, int &year, int &month, int &day, int &hour)
+    {
+        logCivilFromDays(index / 24, year, month, day);
+        hour = index % 24;
+    }
+
+    bool empty() const { return buckets.empty(); }
+    int firstHour() const { return base; }
+    int endHour() const { return base + (int)buckets.size(); }
+    bool covers(int hour) const { return hour >= base && hour < endHour(); }
+
+    /**
+     * Bucket of an hour, extending the covered range if needed.
+     */
+    Bucket &at(int hour)
+    {
+        if (buckets.empty())
+        {
+            base = hour;
+            buckets.resize(1);
+        }
+        else if (hour < base)
+        {
+            // Leave some slack in front so walking backwards does not shift the vector every hour
+            int grow = max(base - hour, (int)buckets.size());
+            buckets.insert(buckets.begin(), grow, Bucket());
+            base -= grow;
+        }
+        else if (hour >= endHour())
+        {
+            buckets.resize(hour - base + 1);
+        }
+        return buckets[hour - base];
+    }
+
+    /**
+     * Bucket of an hour inside the covered range (see covers).
+     */
+    Bucket &operator[](int hour) { return buckets[hour - base]; }
+    const Bucket &operator[](int hour) const { return buckets[hour - base]; }
+
+    void clear()
+    {
+        buckets.clear();
+        base = 0;
+    }
+
+private:
+    int base;               // Hour number of buckets[0]
+    vector<Bucket> buckets; // One bucket per hour in [base, base + size)
+};
+
+#endif // HOURLY_STORE_H
@@ -0,0 +1,73 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::MappedFile() : fd(-1), mapping(NULL), length(0) {}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const string &filename)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        close();
+        return false;
+    }
+
+    void *address = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    mapping = static_cast<const char *>(address);
+    length = info.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapping != NULL)
+    {
+        munmap(const_cast<char *>(mapping), length);
+        mapping = NULL;
+        length = 0;
+    }
+
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void MappedFile::adviseSequential(size_t offset, size_t length) const
+{
+    if (mapping == NULL || length == 0)
+    {
+        return;
+    }
+
+    // madvise needs a page aligned address, so round the start down
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t alignedOffset = offset - (offset % pageSize);
+    madvise(const_cast<char *>(mapping) + alignedOffset, length + (offset - alignedOffset), MADV_SEQUENTIAL);
+}
@@ -0,0 +1,54 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Read-only memory mapping of an entire input file. Threads scan their own
+// byte ranges directly out of the mapping, so no stream position is shared
+// and no line is copied before it is parsed.
+class MappedFile
+{
+public:
+    MappedFile();
+
+    // Unmaps the file if it is still mapped
+    ~MappedFile();
+
+    /**
+     * Opens and maps the file read-only.
+     * @param filename - name of data file
+     * @retval true if the file was mapped, false otherwise
+     */
+    bool open(const string &filename);
+
+    /**
+     * Unmaps the file and closes its descriptor.
+     */
+    void close();
+
+    /**
+     * Hints the kernel that a byte range will be read sequentially so it can
+     * read ahead aggressively for the thread that owns the range.
+     * @param offset - first byte of the range
+     * @param length - number of bytes in the range
+     */
+    void adviseSequential(size_t offset, size_t length) const;
+
+    bool isOpen() const { return mapping != NULL; }
+    const char *data() const { return mapping; }
+    size_t size() const { return length; }
+
+private:
+    // A mapping owns its descriptor, so copying is not allowed
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    int fd;
+    const char *mapping;
+    size_t length;
+};
+
+#endif // MAPPED_FILE_H
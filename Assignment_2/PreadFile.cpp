@@ -0,0 +1,102 @@
+#include "PreadFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+PreadFile::PreadFile() : fd(-1), length(0) {}
+
+PreadFile::~PreadFile()
+{
+    close();
+}
+
+bool PreadFile::open(const string &filename)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        close();
+        return false;
+    }
+
+    length = info.st_size;
+    return true;
+}
+
+void PreadFile::close()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+    length = 0;
+}
+
+size_t PreadFile::readAt(char *buffer, size_t count, size_t offset) const
+{
+    size_t done = 0;
+    while (done < count)
+    {
+        ssize_t got = pread(fd, buffer + done, count - done, offset + done);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            break; // End of file or a read error
+        }
+        done += got;
+    }
+    return done;
+}
+
+size_t PreadFile::nextLineStart(size_t offset) const
+{
+    if (offset == 0 || offset >= length)
+    {
+        return min(offset, length);
+    }
+
+    // Scan from the byte before offset, so a line that starts exactly at offset is kept
+    char window[4096];
+    size_t position = offset - 1;
+    while (position < length)
+    {
+        size_t got = readAt(window, sizeof(window), position);
+        if (got == 0)
+        {
+            break;
+        }
+        const char *newline = (const char *)memchr(window, '\n', got);
+        if (newline != NULL)
+        {
+            return position + (newline - window) + 1;
+        }
+        position += got;
+    }
+    return length;
+}
+
+void PreadFile::adviseSequential(size_t offset, size_t count) const
+{
+    if (fd >= 0 && count > 0)
+    {
+        posix_fadvise(fd, offset, count, POSIX_FADV_SEQUENTIAL);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef PREAD_FILE_H
+#define PREAD_FILE_H
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Input file read with pread(). Every read names its own offset, so any
+// number of threads can read their own byte ranges through the one descriptor
+// at the same time without sharing a file position.
+class PreadFile
+{
+public:
+    PreadFile();
+
+    // Closes the descriptor if it is still open
+    ~PreadFile();
+
+    /**
+     * Opens the file read-only.
+     * @param filename - name of data file
+     * @retval true if the file was opened and is not empty, false otherwise
+     */
+    bool open(const string &filename);
+
+    /**
+     * Closes the descriptor.
+     */
+    void close();
+
+    /**
+     * Reads up to count bytes starting at offset, retrying short and
+     * interrupted reads.
+     * @retval number of bytes read, less than count only at the end of the file or on an error
+     */
+    size_t readAt(char *buffer, size_t count, size_t offset) const;
+
+    /**
+     * First line start at or after offset: offset itself if the byte before it
+     * is a newline, otherwise the byte after the next newline (or the file size).
+     */
+    size_t nextLineStart(size_t offset) const;
+
+    /**
+     * Hints the kernel that a byte range will be read sequentially so it can
+     * read ahead aggressively for the thread that owns the range.
+     */
+    void adviseSequential(size_t offset, size_t count) const;
+
+    bool isOpen() const { return fd >= 0; }
+    int descriptor() const { return fd; }
+    size_t size() const { return length; }
+
+private:
+    // The object owns its descriptor, so copying is not allowed
+    PreadFile(const PreadFile &) = delete;
+    PreadFile &operator=(const PreadFile &) = delete;
+
+    int fd;
+    size_t length;
+};
+
+#endif // PREAD_FILE_H
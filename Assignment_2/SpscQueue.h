@@ -0,0 +1,266 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Time one side of an SpscQueue spent waiting for the other
+struct QueueWaitStats
+{
+    long long waits;        // Times the side found the ring full (producer) or empty (consumer)
+    long long microseconds; // Total time spent waiting
+
+    QueueWaitStats() : waits(0), microseconds(0) {}
+};
+
+/**
+ * Bounded lock-free ring buffer between exactly one producer thread and one
+ * consumer thread.
+ *
+ * The read and write indices live on their own cache lines, and each side
+ * keeps a cached copy of the other side's index so it only touches the shared
+ * line when the cached value says the ring looks full (producer) or empty
+ * (consumer). pushBatch and popBatch move many items per index update.
+ *
+ * A side that has to wait spins briefly, then yields, then parks on a
+ * condition variable. The other side only takes the mutex to wake it when the
+ * parked flag is set, so the uncontended path never locks.
+ *
+ * The producer ends the stream with close(); once the consumer has drained
+ * everything pushed before it, pop and popBatch report end of stream instead
+ * of waiting, so no in-band sentinel item is needed.
+ *
+ * The capacity bounds memory: a producer that gets ahead of its consumer
+ * blocks until space frees up (backpressure). Each side records how often and
+ * for how long it had to wait, which shows which stage is the bottleneck.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    /**
+     * @param capacity - maximum number of queued items, rounded up to a power of two
+     */
+    explicit SpscQueue(size_t capacity)
+        : head(0), cachedTail(0), tail(0), cachedHead(0), closed(false), consumerParked(false), producerParked(false)
+    {
+        setCapacity(capacity);
+    }
+
+    /**
+     * Resizes the ring and resets the wait statistics. Only valid while no
+     * thread is using the queue and it is empty.
+     * @param capacity - maximum number of queued items, rounded up to a power of two
+     */
+    void setCapacity(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        slots.clear();
+        slots.resize(size);
+        mask = size - 1;
+        head.store(0, memory_order_relaxed);
+        tail.store(0, memory_order_relaxed);
+        cachedTail = cachedHead = 0;
+        closed.store(false, memory_order_relaxed);
+        producerStats = consumerStats = QueueWaitStats();
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    // How long the producer was blocked on a full ring; read once the producer has finished
+    const QueueWaitStats &producerWaits() const { return producerStats; }
+
+    // How long the consumer waited on an empty ring; read once the consumer has finished
+    const QueueWaitStats &consumerWaits() const { return consumerStats; }
+
+    // Producer: appends one item, waiting while the ring is full
+    void push(T item)
+    {
+        pushBatch(&item, 1);
+    }
+
+    // Producer: appends count items, publishing as many at a time as fit
+    void pushBatch(T *items, size_t count)
+    {
+        size_t written = 0;
+        size_t position = tail.load(memory_order_relaxed);
+        while (written < count)
+        {
+            size_t space = slots.size() - (position - cachedHead);
+            if (space == 0)
+            {
+                cachedHead = head.load(memory_order_acquire);
+                space = slots.size() - (position - cachedHead);
+                if (space == 0)
+                {
+                    waitFor(producerParked, producerStats, [this, position]
+                            { return position - head.load(memory_order_seq_cst) < slots.size(); });
+                    continue;
+                }
+            }
+
+            size_t n = min(space, count - written);
+            for (size_t i = 0; i < n; ++i)
+            {
+                slots[(position + i) & mask] = move(items[written + i]);
+            }
+            position += n;
+            written += n;
+            tail.store(position, memory_order_release);
+            wake(consumerParked);
+        }
+    }
+
+    // Producer: marks the end of the stream; nothing may be pushed afterwards
+    void close()
+    {
+        closed.store(true, memory_order_release);
+        wake(consumerParked);
+    }
+
+    /**
+     * Consumer: removes one item, waiting while the ring is empty.
+     * @retval false once the stream is closed and drained
+     */
+    bool pop(T &item)
+    {
+        size_t position = head.load(memory_order_relaxed);
+        if (position == cachedTail && !waitForItems(position))
+        {
+            return false;
+        }
+        item = move(slots[position & mask]);
+        head.store(position + 1, memory_order_release);
+        wake(producerParked);
+        return true;
+    }
+
+    /**
+     * Consumer: waits until at least one item is queued, then moves every
+     * queued item (up to maxItems) into out.
+     * @retval number of items appended to out, 0 once the stream is closed and drained
+     */
+    size_t popBatch(vector<T> &out, size_t maxItems)
+    {
+        size_t position = head.load(memory_order_relaxed);
+        if (position == cachedTail && !waitForItems(position))
+        {
+            return 0;
+        }
+
+        size_t n = min(cachedTail - position, maxItems);
+        for (size_t i = 0; i < n; ++i)
+        {
+            out.push_back(move(slots[(position + i) & mask]));
+        }
+        head.store(position + n, memory_order_release);
+        wake(producerParked);
+        return n;
+    }
+
+private:
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // Refreshes cachedTail; false if the ring is still empty because the stream was closed
+    bool waitForItems(size_t position)
+    {
+        cachedTail = tail.load(memory_order_acquire);
+        if (position == cachedTail)
+        {
+            waitFor(consumerParked, consumerStats, [this, position]
+                    { return tail.load(memory_order_seq_cst) != position || closed.load(memory_order_seq_cst); });
+            // The tail is stored before closed is set, so this sees every item pushed before close()
+            cachedTail = tail.load(memory_order_acquire);
+        }
+        return position != cachedTail;
+    }
+
+    // Waits until ready() holds and charges the time to stats
+    template <typename Ready>
+    void waitFor(atomic<bool> &parked, QueueWaitStats &stats, Ready ready)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        spinThenPark(parked, ready);
+        stats.waits++;
+        stats.microseconds += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Spin, then yield, then park until ready() holds
+    template <typename Ready>
+    void spinThenPark(atomic<bool> &parked, Ready ready)
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            if (ready())
+            {
+                return;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        for (int i = 0; i < 64; ++i)
+        {
+            if (ready())
+            {
+                return;
+            }
+            this_thread::yield();
+        }
+
+        unique_lock<mutex> lock(parkMutex);
+        parked.store(true, memory_order_seq_cst);
+        while (!ready())
+        {
+            parkCond.wait(lock);
+        }
+        parked.store(false, memory_order_relaxed);
+    }
+
+    // Wakes the other side if it parked; the fence orders the index store before the flag load
+    void wake(atomic<bool> &parked)
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (parked.load(memory_order_seq_cst))
+        {
+            lock_guard<mutex> lock(parkMutex);
+            parkCond.notify_all();
+        }
+    }
+
+    // Consumer side
+    alignas(64) atomic<size_t> head; // Next slot to read
+    size_t cachedTail;               // Last tail value the consumer saw
+    QueueWaitStats consumerStats;
+
+    // Producer side
+    alignas(64) atomic<size_t> tail; // Next slot to write
+    size_t cachedHead;               // Last head value the producer saw
+    atomic<bool> closed;             // Set by close() after the last push
+    QueueWaitStats producerStats;
+
+    // Parking, only used once a side has run out of spins
+    alignas(64) atomic<bool> consumerParked;
+    atomic<bool> producerParked;
+    mutex parkMutex;
+    condition_variable parkCond;
+
+    vector<T> slots;
+    size_t mask;
+};
+
+#endif // SPSC_QUEUE_H
@@ -2,9 +2,18 @@
 
 using namespace std;
 
+// Bytes of whole lines handed to the batch decoder at a time in READER_MMAP mode
+static const size_t MAPPED_BLOCK_SIZE = 64 * 1024;
+
+// Bytes each thread reads per pread call in READER_PREAD mode
+static const size_t PREAD_BUFFER_SIZE = 1024 * 1024;
+
 TemperatureAnalysis::TemperatureAnalysis(const string &filename)
 {
     this->numThreads = 12;
+    this->filename = filename;
+    this->readerMode = READER_MMAP;
+    this->useMonthIndex = false;
     initializeFile(filename); // Ensure file is opened successfully
 
     this->fileSize = inputFile.tellg(); // Get file size
@@ -52,8 +61,10 @@ void TemperatureAnalysis::initializeFile(const string &filename)
 
 /**
  * Processes temperature data from a log file in parallel using multiple threads.
- * Each thread handles a segment of the file, parsing temperature records and
- * updating the shared dataset with average temperature values for each hour.
+ * Each thread handles a segment of the file, parsing temperature records into
+ * its own SegmentAggregate. The aggregates are then merged pairwise in a tree
+ * and the merged dataset is kept for the report. Only per-hour summaries are
+ * kept, so memory does not grow with the size of the log.
  *
  * **Partitioning**: The data is divided into segments based on file size, 
  * and each thread processes its own segment.
@@ -62,6 +73,137 @@ void TemperatureAnalysis::initializeFile(const string &filename)
  * an equal number of bytes to each thread's segment.
  */
 void TemperatureAnalysis::processTemperatureData(void)
+{
+    // A columnar cache written by convertLogToColumnar is split by blocks instead of bytes
+    if (ColumnarLog::isColumnarFile(filename))
+    {
+        processColumnarData();
+        return;
+    }
+
+    if (!preadFile.open(filename))
+    {
+        cerr << "Error opening file: " << filename << endl;
+        return;
+    }
+
+    // Map the whole file once; every thread then reads its own range of the mapping
+    if (readerMode == READER_MMAP && !mappedFile.open(filename))
+    {
+        cerr << "Error mapping file: " << filename << ", falling back to pread reader" << endl;
+        readerMode = READER_PREAD;
+    }
+
+    // Only the byte ranges of heating and cooling months need reading; every other reading
+    // would be dropped by addSample anyway
+    vector<pair<uint64_t, uint64_t>> ranges(1, make_pair((uint64_t)0, (uint64_t)fileSize));
+    LogIndex index;
+    if (useMonthIndex && index.loadOrBuild(filename) && index.logSize() == (uint64_t)fileSize)
+    {
+        ranges = index.rangesFor(reportMonths());
+    }
+
+    runSegments(splitRanges(preadFile, ranges, numThreads));
+
+    // close file
+    mappedFile.close();
+    preadFile.close();
+    inputFile.close();
+}
+
+/**
+ * Reads a columnar cache instead of the text log. Threads get equal runs of
+ * blocks; blocks without a reading of a heating or cooling month are skipped
+ * using the cache's month index, since addSample would drop all of them.
+ */
+void TemperatureAnalysis::processColumnarData(void)
+{
+    if (!columnarLog.open(filename))
+    {
+        cerr << "Error opening columnar cache: " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    columnarLog.selectBlocks(reportMonths(), selectedBlocks);
+
+    vector<vector<pair<long, long>>> segments(numThreads);
+    for (int i = 0; i < numThreads; ++i)
+    {
+        segments[i].push_back(make_pair((long)(columnarLog.blockCount() * i / numThreads),
+                                        (long)(columnarLog.blockCount() * (i + 1) / numThreads)));
+    }
+    runSegments(segments);
+
+    columnarLog.close();
+    inputFile.close();
+}
+
+/**
+ * Splits byte ranges of a file into parts segments of about the same number
+ * of bytes.
+ *
+ * **Partitioning**: A line belongs to the segment its first byte falls in, so
+ * every cut is moved to the next line start before any thread runs. Ranges
+ * start and end at line starts themselves. A line longer than a segment
+ * pushes a cut past the following targets; those cuts are clamped to the
+ * previous one and the empty segments they would make are dropped.
+ */
+vector<vector<pair<long, long>>> TemperatureAnalysis::splitRanges(const PreadFile &file,
+                                                                  const vector<pair<uint64_t, uint64_t>> &ranges,
+                                                                  int parts)
+{
+    long total = 0;
+    for (const auto &range : ranges)
+    {
+        total += range.second - range.first;
+    }
+
+    vector<vector<pair<long, long>>> segments(parts);
+    int part = 0;
+    long done = 0; // Bytes handed to the segments so far
+    for (const auto &range : ranges)
+    {
+        long cursor = range.first;
+        long end = range.second;
+        while (cursor < end)
+        {
+            long target = total * (part + 1) / parts;
+            long cut = end;
+            if (part < parts - 1 && cursor + (target - done) < end)
+            {
+                cut = max(cursor, min(end, (long)file.nextLineStart(max(cursor, cursor + (target - done)))));
+            }
+
+            if (cut > cursor)
+            {
+                segments[part].push_back(make_pair(cursor, cut));
+            }
+            done += cut - cursor;
+            cursor = cut;
+            if (done >= target && part < parts - 1)
+            {
+                part++;
+            }
+        }
+    }
+    return segments;
+}
+
+/**
+ * Heating and cooling months, the only ones the report looks at.
+ */
+vector<int> TemperatureAnalysis::reportMonths() const
+{
+    vector<int> months(heatingMonths);
+    months.insert(months.end(), coolingMonths.begin(), coolingMonths.end());
+    return months;
+}
+
+/**
+ * Runs one thread per segment, then merges their aggregates into dataset.
+ * @arg segments - ranges of each thread, byte offsets or block numbers, in file order
+ */
+void TemperatureAnalysis::runSegments(const vector<vector<pair<long, long>>> &segments)
 {
     pthread_t threads[numThreads];
     ThreadArgs *threadArgs[numThreads]; // Declare an array of ThreadArgs pointers
@@ -71,8 +213,7 @@ void TemperatureAnalysis::processTemperatureData(void)
     for (int i = 0; i < numThreads; ++i)
     {
         threadArgs[i] = new ThreadArgs(); // Dynamically allocate new ThreadArgs for each thread
-        threadArgs[i]->startPosition = i * segmentSize;
-        threadArgs[i]->endPosition = (i == numThreads - 1) ? fileSize : (i + 1) * segmentSize;
+        threadArgs[i]->ranges = segments[i];
         threadArgs[i]->threadId = i;
         threadArgs[i]->analysis = this; // Assign this to the analysis member
 
@@ -91,11 +232,59 @@ void TemperatureAnalysis::processTemperatureData(void)
     for (int i = 0; i < numThreads; ++i)
     {
         pthread_join(threads[i], NULL);
-        delete threadArgs[i]; // Clean up allocated memory for each threadArgs
     }
 
-    // close file
-    inputFile.close();
+    // **Communication**: Merge neighbouring aggregates in a tree. Each round merges
+    // segment i with segment i + stride in parallel, so file order is preserved.
+    for (int stride = 1; stride < numThreads; stride *= 2)
+    {
+        vector<pthread_t> mergeThreads;
+        vector<MergeArgs> mergeArgs;
+        mergeArgs.reserve(numThreads);
+        for (int i = 0; i + stride < numThreads; i += 2 * stride)
+        {
+            mergeArgs.push_back({this, &threadArgs[i]->aggregate, &threadArgs[i + stride]->aggregate});
+        }
+
+        mergeThreads.resize(mergeArgs.size());
+        for (size_t i = 0; i < mergeArgs.size(); ++i)
+        {
+            pthread_create(&mergeThreads[i], NULL, &TemperatureAnalysis::mergeThreadFunction, &mergeArgs[i]);
+        }
+        for (size_t i = 0; i < mergeThreads.size(); ++i)
+        {
+            pthread_join(mergeThreads[i], NULL);
+        }
+    }
+
+    SegmentAggregate &merged = threadArgs[0]->aggregate;
+    if (!merged.ordered)
+    {
+        // Hours of one segment reappear in another, so only a scan in file order filters them right
+        cout << "Log is not in time order, reading it again in one pass" << endl;
+        merged = SegmentAggregate();
+        merged.sequential = true;
+        for (int i = 0; i < numThreads; ++i)
+        {
+            processRanges(segments[i], merged);
+        }
+    }
+    else if (merged.hasHead)
+    {
+        // The head hour of the first segment has nothing before it
+        replaySamples(merged.headHour, merged.headSamples, merged);
+    }
+
+    // That head hour comes last in the extremes, and the unordered pass adds them in file order
+    stable_sort(merged.extremes.begin(), merged.extremes.end(),
+                [](const HourExtreme &a, const HourExtreme &b) { return a.hour < b.hour; });
+    dataset = move(merged.dataset);
+    extremes = move(merged.extremes);
+
+    for (int i = 0; i < numThreads; ++i)
+    {
+        delete threadArgs[i]; // Clean up allocated memory for each threadArgs
+    }
 }
 
 /**
@@ -115,7 +304,7 @@ void *TemperatureAnalysis::threadFunction(void *args)
  * **Partitioning**: Each thread works on its own segment of the file, 
  * with clear start and end positions to avoid overlap.
  *
- * **Coordination**: Mutexes are used to control access to shared data structures (dataset and hourlyAvg).
+ * **Coordination**: Each thread writes only to its own aggregate, so no locks are taken.
  * 
  * @param args Pointer to ThreadArgs struct containing the start and end positions for processing.
  * @return NULL
@@ -123,71 +312,393 @@ void *TemperatureAnalysis::threadFunction(void *args)
 void *TemperatureAnalysis::processSegment(void *args)
 {
     ThreadArgs *threadArgs = (ThreadArgs *)args;
+    processRanges(threadArgs->ranges, threadArgs->aggregate);
+    return NULL;
+}
+
+/**
+ * Reads ranges in order into one aggregate with the configured reader.
+ */
+void TemperatureAnalysis::processRanges(const vector<pair<long, long>> &ranges, SegmentAggregate &aggregate)
+{
+    for (const auto &range : ranges)
+    {
+        if (!aggregate.ordered)
+        {
+            break; // The input will be read again in one pass
+        }
+
+        if (columnarLog.isOpen())
+        {
+            processColumnarSegment(range.first, range.second, aggregate);
+        }
+        else if (readerMode == READER_MMAP)
+        {
+            processMappedSegment(range.first, range.second, aggregate);
+        }
+        else if (readerMode == READER_PREAD)
+        {
+            processPreadSegment(range.first, range.second, aggregate);
+        }
+        else
+        {
+            processStreamSegment(range.first, range.second, aggregate);
+        }
+    }
+}
 
-    long startPos = threadArgs->startPosition;
-    long endPos = threadArgs->endPosition;
+/**
+ * Marks an aggregate unordered and frees what it gathered.
+ */
+void TemperatureAnalysis::dropUnordered(SegmentAggregate &aggregate)
+{
+    aggregate.ordered = false;
+    aggregate.dataset.clear();
+    vector<HourExtreme>().swap(aggregate.extremes);
+    vector<double>().swap(aggregate.headSamples);
+}
 
-    // Seek to the start position
-    inputFile.seekg(startPos);
+/**
+ * Reads a segment through an ifstream of the calling thread (READER_STREAM).
+ * Segments start and end at line boundaries.
+ */
+void TemperatureAnalysis::processStreamSegment(long startPos, long endPos, SegmentAggregate &aggregate)
+{
+    // A stream of its own, so no other thread moves the position
+    ifstream segmentFile(filename);
+    segmentFile.seekg(startPos);
 
-    // Ensure we start at the beginning of a line
-    if (startPos != 0)
+    // Count bytes instead of asking tellg, which is slow on every line
+    long position = startPos;
+    string line;
+    while (position < endPos && getline(segmentFile, line))
     {
-        string temp;
-        getline(inputFile, temp);
+        position += line.size() + 1;
+        addSample(parseLine(line), aggregate);
     }
+}
 
-    string line;
-    while (inputFile.tellg() < endPos && getline(inputFile, line))
+/**
+ * Reads a segment out of the mapped file (READER_MMAP). Segments start and
+ * end at line boundaries. Lines are decoded in blocks by parseLogBlock.
+ */
+void TemperatureAnalysis::processMappedSegment(long startPos, long endPos, SegmentAggregate &aggregate)
+{
+    const char *data = mappedFile.data();
+    const char *cursor = data + startPos;
+    const char *segmentEnd = data + endPos;
+
+    mappedFile.adviseSequential(startPos, endPos - startPos);
+
+    // Decode the segment a block of whole lines at a time
+    LogBatch batch;
+    while (cursor < segmentEnd)
     {
-        TemperatureData data = parseLine(line);
+        const char *blockEnd = cursor + min((long)MAPPED_BLOCK_SIZE, (long)(segmentEnd - cursor));
+        if (blockEnd < segmentEnd)
+        {
+            const char *newline = (const char *)memchr(blockEnd, '\n', segmentEnd - blockEnd);
+            blockEnd = (newline == NULL) ? segmentEnd : newline + 1;
+        }
 
-        if (data.hour == INT_MAX)
+        addBlock(cursor, blockEnd - cursor, batch, aggregate);
+        cursor = blockEnd;
+    }
+}
+
+/**
+ * Reads a segment with pread (READER_PREAD), a buffer of whole lines at a
+ * time; the unfinished line at the end of a read moves to the front of the
+ * buffer for the next one. Segments start and end at line boundaries.
+ */
+void TemperatureAnalysis::processPreadSegment(long startPos, long endPos, SegmentAggregate &aggregate)
+{
+    preadFile.adviseSequential(startPos, endPos - startPos);
+
+    vector<char> buffer(PREAD_BUFFER_SIZE);
+    size_t carried = 0; // Bytes of an unfinished line at the front of the buffer
+    long position = startPos;
+    LogBatch batch;
+    while (position < endPos)
+    {
+        // A single line longer than the buffer: make room for the rest of it
+        if (carried == buffer.size())
         {
-            continue; // Skip invalid data lines
+            buffer.resize(buffer.size() * 2);
         }
 
-        if (find(coolingMonths.begin(), coolingMonths.end(), data.month) == coolingMonths.end() && find(heatingMonths.begin(), heatingMonths.end(), data.month) == heatingMonths.end())
+        size_t got = preadFile.readAt(buffer.data() + carried, min((long)(buffer.size() - carried), endPos - position), position);
+        if (got == 0)
         {
-            continue; // skip months we dont care about
+            break; // The file shrank or could not be read
         }
+        position += got;
+        size_t filled = carried + got;
 
-        hourlyData current_hour(data.year, data.month, data.day, data.hour);
-
-        // **Communication**: Threads update shared structures like 'dataset' and 'hourlyAvg', 
-        // necessitating careful management of access via mutexes.
-        // populate the dataset by hour
-        datasetMutex.lock();
-        if (dataset.find(current_hour) != dataset.end() && !dataset[current_hour].empty()) {
-            // If the current hour exists and the vector is not empty, check for anomaly
-            if (!isAnomaly(dataset[current_hour].back(), data.temperature)) {
-                dataset[current_hour].push_back(data.temperature);
-            } else {
-                datasetMutex.unlock();
-                continue;  // Skip if there's no anomaly
-            }
-        } else {
-            // If current hour doesn't exist or the vector is empty, add the temperature directly
-            dataset[current_hour].push_back(data.temperature);
+        // The segment ends with a whole line, so the last read leaves nothing over
+        size_t whole = filled;
+        if (position < endPos)
+        {
+            const char *lastBreak = (const char *)memrchr(buffer.data(), '\n', filled);
+            whole = (lastBreak == NULL) ? 0 : lastBreak + 1 - buffer.data();
         }
-        datasetMutex.unlock();
 
+        addBlock(buffer.data(), whole, batch, aggregate);
+        carried = filled - whole;
+        memmove(buffer.data(), buffer.data() + whole, carried);
+    }
+    addBlock(buffer.data(), carried, batch, aggregate);
+}
 
-        // Lock mutex to safely update the shared dataset
-        hourlyAvgMutex.lock();
-        // Update hourly average dataset
-        if (hourlyAvg.find(current_hour) == hourlyAvg.end())
+/**
+ * Decodes a block of whole lines with parseLogBlock and adds every reading.
+ */
+void TemperatureAnalysis::addBlock(const char *data, size_t length, LogBatch &batch, SegmentAggregate &aggregate)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    batch.clear();
+    parseLogBlock(data, length, batch);
+    addBatch(batch, aggregate);
+}
+
+/**
+ * Reads a run of blocks out of the columnar cache. Timestamps and temperatures
+ * are decoded from their columns, so nothing is parsed.
+ */
+void TemperatureAnalysis::processColumnarSegment(long firstBlock, long endBlock, SegmentAggregate &aggregate)
+{
+    columnarLog.adviseSequential(firstBlock, endBlock);
+
+    LogBatch batch;
+    for (long i = firstBlock; i < endBlock; ++i)
+    {
+        if (!selectedBlocks[i])
         {
-            hourlyAvg[current_hour] = make_tuple(data.temperature, 1);
+            continue;
         }
-        else
+
+        batch.clear();
+        if (!columnarLog.decodeBlock(i, batch))
+        {
+            cerr << "Corrupt block " << i << " in " << filename << endl;
+            exit(EXIT_FAILURE); // Skipping its readings would quietly change every statistic
+        }
+        addBatch(batch, aggregate);
+    }
+}
+
+/**
+ * Adds every reading of a decoded batch, in order.
+ */
+void TemperatureAnalysis::addBatch(const LogBatch &batch, SegmentAggregate &aggregate)
+{
+    // A packed timestamp counts seconds from the same origin as hourIndex, so the hour is one
+    // division; the month is only looked up when the hour changes
+    int lastHour = -1;
+    bool wanted = false;
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        int hour = (int)(batch.timestamps[i] / 3600u);
+        if (hour != lastHour)
+        {
+            int year, month, day, hourOfDay;
+            HourlyStore<HourBucket>::hourFields(hour, year, month, day, hourOfDay);
+            lastHour = hour;
+            wanted = isReportMonth(month);
+        }
+        if (wanted)
+        {
+            addReading(hour, batch.temperatures[i], aggregate);
+        }
+    }
+}
+
+/**
+ * Whether readings of a month are kept for the report.
+ */
+bool TemperatureAnalysis::isReportMonth(int month) const
+{
+    return find(coolingMonths.begin(), coolingMonths.end(), month) != coolingMonths.end() ||
+           find(heatingMonths.begin(), heatingMonths.end(), month) != heatingMonths.end();
+}
+
+/**
+ * Applies the month filter and anomaly check to one parsed reading and
+ * records it in the thread's aggregate.
+ */
+void TemperatureAnalysis::addSample(const TemperatureData &data, SegmentAggregate &aggregate)
+{
+    if (data.month == INT_MAX)
+    {
+        return; // Skip invalid data lines
+    }
+
+    if (!isReportMonth(data.month))
+    {
+        return; // skip months we dont care about
+    }
+
+    addReading(HourlyStore<HourBucket>::hourIndex(data.year, data.month, data.day, data.hour), data.temperature, aggregate);
+}
+
+/**
+ * Applies the anomaly check to one reading of a wanted month and records it
+ * in the thread's aggregate.
+ */
+void TemperatureAnalysis::addReading(int current_hour, double temperature, SegmentAggregate &aggregate)
+{
+    if (!aggregate.sequential)
+    {
+        if (!aggregate.ordered)
+        {
+            return; // Dropped; see dropUnordered
+        }
+
+        // The hour the segment starts in is filtered later, when the merge knows what came before it
+        if (!aggregate.hasHead)
+        {
+            aggregate.hasHead = true;
+            aggregate.headHour = current_hour;
+        }
+        else if (current_hour < aggregate.lastHour)
+        {
+            dropUnordered(aggregate);
+            return;
+        }
+        aggregate.lastHour = current_hour;
+        if (current_hour == aggregate.headHour)
+        {
+            aggregate.headSamples.push_back(temperature);
+            return;
+        }
+    }
+
+    HourBucket &bucket = aggregate.dataset.at(current_hour);
+    if (bucket.count() > 0 && isAnomaly(bucket.last, temperature))
+    {
+        return; // Skip anomalies
+    }
+    acceptSample(bucket, current_hour, temperature, aggregate.extremes);
+}
+
+/**
+ * Adds an accepted reading to its hour's bucket, and to extremes if it is
+ * a new maximum or minimum of the hour.
+ */
+void TemperatureAnalysis::acceptSample(HourBucket &bucket, int hour, double temperature, vector<HourExtreme> &extremes)
+{
+    if (bucket.count() == 0 || temperature > bucket.stats.max)
+    {
+        extremes.push_back({hour, true, temperature});
+    }
+    if (bucket.count() == 0 || temperature < bucket.stats.min)
+    {
+        extremes.push_back({hour, false, temperature});
+    }
+    bucket.add(temperature);
+}
+
+/**
+ * Adds readings to an hour, dropping each one that is an anomaly
+ * relative to the last reading accepted before it.
+ */
+void TemperatureAnalysis::replaySamples(int hour, const vector<double> &pending, SegmentAggregate &aggregate)
+{
+    HourBucket &bucket = aggregate.dataset.at(hour);
+    for (double temperature : pending)
+    {
+        if (bucket.count() == 0 || !isAnomaly(bucket.last, temperature))
+        {
+            acceptSample(bucket, hour, temperature, aggregate.extremes);
+        }
+    }
+}
+
+/**
+ * First running maximum of an hour above threshold, or first running
+ * minimum below it, from extremes.
+ */
+const HourExtreme *TemperatureAnalysis::firstExtreme(int hour, bool high, double threshold) const
+{
+    vector<HourExtreme>::const_iterator extreme =
+        lower_bound(extremes.begin(), extremes.end(), hour,
+                    [](const HourExtreme &candidate, int value) { return candidate.hour < value; });
+    for (; extreme != extremes.end() && extreme->hour == hour; ++extreme)
+    {
+        if (extreme->high == high && (high ? extreme->value > threshold : extreme->value < threshold))
+        {
+            return &*extreme;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Merges the aggregate of the following segment(s) into the preceding one.
+ * The right head hour is replayed against what the left side accepted.
+ */
+void TemperatureAnalysis::mergeAggregates(SegmentAggregate &left, SegmentAggregate &right)
+{
+    if (!left.ordered || !right.ordered)
+    {
+        dropUnordered(left);
+        right = SegmentAggregate();
+        return;
+    }
+    if (!right.hasHead)
+    {
+        return; // Nothing was read on the right
+    }
+    if (!left.hasHead)
+    {
+        left = move(right);
+        return;
+    }
+    if (right.headHour < left.lastHour)
+    {
+        // The right side starts before the left one ended, so some hour may be on both sides
+        dropUnordered(left);
+        right = SegmentAggregate();
+        return;
+    }
+    left.lastHour = right.lastHour;
+
+    if (right.headHour == left.headHour)
+    {
+        // The left side never left this hour either, so it stays pending for the next merge
+        left.headSamples.insert(left.headSamples.end(), right.headSamples.begin(), right.headSamples.end());
+    }
+    else
+    {
+        replaySamples(right.headHour, right.headSamples, left);
+    }
+
+    // Every other hour on the right was already filtered, and comes after every hour on the left,
+    // so its extremes follow the left ones unchanged
+    for (int hour = right.dataset.firstHour(); hour < right.dataset.endHour(); ++hour)
+    {
+        const HourBucket &rightBucket = right.dataset[hour];
+        if (rightBucket.count() > 0)
         {
-            hourlyAvg[current_hour] = make_tuple(
-                get<0>(hourlyAvg[current_hour]) + data.temperature,
-                get<1>(hourlyAvg[current_hour]) + 1);
+            left.dataset.at(hour).append(rightBucket);
         }
-        hourlyAvgMutex.unlock();
     }
+    left.extremes.insert(left.extremes.end(), right.extremes.begin(), right.extremes.end());
+
+    right = SegmentAggregate();
+}
+
+/**
+ * Thread function for one pairwise merge, passed to pthread_create.
+ */
+void *TemperatureAnalysis::mergeThreadFunction(void *args)
+{
+    MergeArgs *mergeArgs = (MergeArgs *)args;
+    mergeArgs->analysis->mergeAggregates(*mergeArgs->left, *mergeArgs->right);
     return NULL;
 }
 
@@ -263,26 +774,26 @@ void TemperatureAnalysis::generateReport(const string &reportName)
  */
 TemperatureData TemperatureAnalysis::parseLine(const string &line)
 {
-    stringstream ss(line);
-    char delim{};
-
-    int month, day, year, hour, minute, second;
-    float temperature;
+    return parseLine(line.data(), line.size());
+}
 
-    if (line.empty())
+/**
+ * Same as parseLine(const string&) but reads the record straight out of a
+ * buffer (e.g. the mapped file) without allocating.
+ * @arg line - first character of the record
+ * @arg length - number of characters in the record, excluding the newline
+ * @retval struct defined in TemperatureAnalysis.h which holds date, time, temperature
+ */
+TemperatureData TemperatureAnalysis::parseLine(const char *line, size_t length)
+{
+    LogRecord record;
+    if (parseLogLine(line, length, record) != PARSE_OK)
     {
-        // Return an empty object for an empty line
+        // Blank and malformed lines are both returned as an invalid reading
         return TemperatureData(INT_MAX, 0, 0, 0, 0, 0, 0.0);
     }
 
-    // store date into temporary fields
-    ss >> month >> delim >> day >> delim >> year;
-    // store time into temporary fields
-    ss >> hour >> delim >> minute >> delim >> second;
-    // store temperature
-    ss >> temperature >> delim;
-
-    return TemperatureData(month, day, year, hour, minute, second, temperature);
+    return TemperatureData(record.month, record.day, record.year, record.hour, record.minute, record.second, record.temperature);
 }
 
 /**
@@ -297,6 +808,12 @@ bool TemperatureAnalysis::isAnomaly(double currentTemp, double previousTemp)
     return abs(currentTemp - previousTemp) > 2.0;
 }
 
+void TemperatureAnalysis::setThreads(int count)
+{
+    numThreads = max(1, count);
+    segmentSize = fileSize / numThreads;
+}
+
 void TemperatureAnalysis::setHeatingMonths(const vector<int> &months)
 {
     heatingMonths = months;
@@ -307,6 +824,16 @@ void TemperatureAnalysis::setCoolingMonths(const vector<int> &months)
     coolingMonths = months;
 }
 
+void TemperatureAnalysis::setReaderMode(ReaderMode mode)
+{
+    readerMode = mode;
+}
+
+void TemperatureAnalysis::setMonthIndex(bool enabled)
+{
+    useMonthIndex = enabled;
+}
+
 /**
  * Process Cooling Month: Detect temperatures below 1 standard deviation (for cooling).
  * 
@@ -314,7 +841,7 @@ void TemperatureAnalysis::setCoolingMonths(const vector<int> &months)
  * 
  * Load Balancing: Each month has its own thread, balancing work across months.
  * 
- * Communication: Threads access shared data (e.g., `hourlyAvg` and `dataset`), requiring careful access with locks.
+ * Communication: Threads only read `dataset`; writes to the report file require careful access with locks.
  * 
  * Coordination: Mutexes ensure thread-safe reporting, allowing threads to safely write to the report file.
  */
@@ -325,41 +852,32 @@ void *TemperatureAnalysis::processCoolingMonth(void *args)
     int month = reportArgs->month;
     ofstream &reportFile = *reportArgs->reportFile;
 
-    // Loop through each hour in hourlyAvg for the given month
-    for (const auto &hourEntry : analysis->hourlyAvg)
+    // Loop through each hour in the dataset for the given month
+    for (int index = analysis->dataset.firstHour(); index < analysis->dataset.endHour(); ++index)
     {
-        const hourlyData &hData = hourEntry.first;
-        if (hData.month == month)
+        const HourBucket &bucket = analysis->dataset[index];
+        if (bucket.count() == 0)
         {
-            double sumTemps = get<0>(hourEntry.second);
-            int countTemps = get<1>(hourEntry.second);
+            continue; // No readings in this hour
+        }
 
-            if (countTemps > 0)
+        int year, hourMonth, day, hour;
+        HourlyStore<HourBucket>::hourFields(index, year, hourMonth, day, hour);
+        if (hourMonth == month)
+        {
+            // Population statistics of the hour's accepted readings
+            double mean = bucket.stats.mean;
+            double stddev = sqrt(bucket.stats.variance());
+
+            // Check for cooling issues: temp < (mean - stddev). Only the first such reading is reported,
+            // and it is always one of the hour's running minima.
+            const HourExtreme *issue = analysis->firstExtreme(index, false, mean - stddev);
+            if (issue != NULL)
             {
-                // Calculate mean temperature
-                double mean = sumTemps / countTemps;
-                double variance = 0.0;
-
-                // Calculate variance for the current hour
-                for (const auto &tempEntry : analysis->dataset[hData])
-                {
-                    variance += (tempEntry - mean) * (tempEntry - mean);
-                }
-                variance /= countTemps;
-                double stddev = sqrt(variance);
-
-                // Check for cooling issues: temp < (mean - stddev)
-                for (const auto &tempEntry : analysis->dataset[hData])
-                {
-                    if (tempEntry < (mean - stddev))
-                    {
-                        pthread_mutex_lock(&analysis->reportMutex); // Lock mutex
-                        reportFile << "Cooling issue detected: " << month << "/" << hData.day << "/" << hData.year
-                                   << " At Hour: " << hData.hour << " | Temp: " << tempEntry << endl;
-                        pthread_mutex_unlock(&analysis->reportMutex); // Unlock mutex
-                        break;                                        // Stop further checks for this hour if an issue is found
-                    }
-                }
+                pthread_mutex_lock(&analysis->reportMutex); // Lock mutex
+                reportFile << "Cooling issue detected: " << month << "/" << day << "/" << year
+                           << " At Hour: " << hour << " | Temp: " << issue->value << endl;
+                pthread_mutex_unlock(&analysis->reportMutex); // Unlock mutex
             }
         }
     }
@@ -374,7 +892,7 @@ void *TemperatureAnalysis::processCoolingMonth(void *args)
  * 
  * Load Balancing: Each month’s data is processed independently in its own thread, balancing the workload.
  * 
- * Communication: Access to shared data (hourlyAvg, dataset, and report file) requires locking for consistency.
+ * Communication: dataset is only read here; the report file requires locking for consistency.
  * 
  * Coordination: Mutexes are used to facilitate access to shared data during report writing.
  */
@@ -385,41 +903,32 @@ void *TemperatureAnalysis::processHeatingMonth(void *args)
     int month = reportArgs->month;
     ofstream &reportFile = *reportArgs->reportFile;
 
-    // Loop through each hour in hourlyAvg for the given month
-    for (const auto &hourEntry : analysis->hourlyAvg)
+    // Loop through each hour in the dataset for the given month
+    for (int index = analysis->dataset.firstHour(); index < analysis->dataset.endHour(); ++index)
     {
-        const hourlyData &hData = hourEntry.first;
-        if (hData.month == month)
+        const HourBucket &bucket = analysis->dataset[index];
+        if (bucket.count() == 0)
         {
-            double sumTemps = get<0>(hourEntry.second);
-            int countTemps = get<1>(hourEntry.second);
+            continue; // No readings in this hour
+        }
 
-            if (countTemps > 0)
+        int year, hourMonth, day, hour;
+        HourlyStore<HourBucket>::hourFields(index, year, hourMonth, day, hour);
+        if (hourMonth == month)
+        {
+            // Population statistics of the hour's accepted readings
+            double mean = bucket.stats.mean;
+            double stddev = sqrt(bucket.stats.variance());
+
+            // Check for heating issues: temp > (mean + stddev). Only the first such reading is reported,
+            // and it is always one of the hour's running maxima.
+            const HourExtreme *issue = analysis->firstExtreme(index, true, mean + stddev);
+            if (issue != NULL)
             {
-                // Calculate mean temperature
-                double mean = sumTemps / countTemps;
-                double variance = 0.0;
-
-                // Calculate variance for the current hour
-                for (const auto &tempEntry : analysis->dataset[hData])
-                {
-                    variance += (tempEntry - mean) * (tempEntry - mean);
-                }
-                variance /= countTemps;
-                double stddev = sqrt(variance);
-
-                // Check for heating issues: temp > (mean + stddev)
-                for (const auto &tempEntry : analysis->dataset[hData])
-                {
-                    if (tempEntry > (mean + stddev))
-                    {
-                        pthread_mutex_lock(&analysis->reportMutex); // Lock mutex
-                        reportFile << "Heating issue detected: " << month << "/" << hData.day << "/" << hData.year
-                                   << " At Hour: " << hData.hour << " | Temp: " << tempEntry << endl;
-                        pthread_mutex_unlock(&analysis->reportMutex); // Unlock mutex
-                        break;                                        // Stop further checks for this hour if an issue is found
-                    }
-                }
+                pthread_mutex_lock(&analysis->reportMutex); // Lock mutex
+                reportFile << "Heating issue detected: " << month << "/" << day << "/" << year
+                           << " At Hour: " << hour << " | Temp: " << issue->value << endl;
+                pthread_mutex_unlock(&analysis->reportMutex); // Unlock mutex
             }
         }
     }
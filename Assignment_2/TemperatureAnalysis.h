@@ -8,12 +8,21 @@
 #include <map>
 #include <cmath>
 #include <sstream>
+#include <cstring>
 #include <limits.h>
 #include <pthread.h>
 #include <tuple>
 #include <algorithm>
 #include <mutex>
 #include <unordered_map>
+#include "LogBatch.h"
+#include "HourlyStore.h"
+#include "LogParser.h"
+#include "RunningStats.h"
+#include "MappedFile.h"
+#include "PreadFile.h"
+#include "ColumnarLog.h"
+#include "LogIndex.h"
 
 using namespace std;
 
@@ -31,32 +40,97 @@ struct TemperatureData {
         : month(month), day(day), year(year), hour(hour), minute(minute), second(second), temperature(temperature) {}
 };
 
-struct hourlyData {
-    int year;
-    int month;
-    int day;
-    int hour;
+// Streaming summary of the accepted readings of one hour: mergeable
+// statistics and the last accepted reading for the anomaly filter. Memory
+// does not grow with the number of readings, and buckets are plain values
+// stored densely in an HourlyStore. The running extremes the exceedance
+// report needs are kept apart, in a table of HourExtreme.
+struct HourBucket {
+    RunningStats stats;
+    double last;
+
+    HourBucket() : last(0.0) {}
+
+    long long count() const { return stats.count; }
 
-    // Overload the < operator for comparison
-    bool operator<(const hourlyData& other) const {
-        if (year != other.year) return year < other.year; // Compare year first
-        if (month != other.month) return month < other.month;
-        if (day != other.day) return day < other.day;
-        return hour < other.hour;
+    void add(double temperature)
+    {
+        stats.add(temperature);
+        last = temperature;
     }
 
-    hourlyData(int year, int month, int day, int hour) : year(year), month(month), day(day), hour(hour) {}
+    // Appends the readings accepted after this bucket's readings
+    void append(const HourBucket &later)
+    {
+        stats.merge(later.stats);
+        last = later.last;
+    }
+};
+
+// An accepted reading that was higher (or lower) than every reading accepted
+// before it in its hour. The first reading of an hour above (below) a
+// threshold is always one of these, so the report can find it once the
+// hour's statistics are known (see ExceedanceCandidates).
+struct HourExtreme {
+    int hour;       // Hour number (HourlyStore::hourIndex)
+    bool high;      // A new maximum of the hour, else a new minimum
+    double value;
 };
 
 // TemperatureAnalysis class to encapsulate functionality
 class TemperatureAnalysis {
 public:
+    // How worker threads read their segment of the input file
+    enum ReaderMode {
+        READER_STREAM,  // Each thread reads its byte range through its own ifstream with getline
+        READER_MMAP,    // Each thread scans its byte range out of a read-only mapping
+        READER_PREAD    // Each thread pread()s its byte range into its own reusable buffer
+    };
+
+    /**
+     * Readings gathered by one thread from its segment, merged into dataset once
+     * every thread is done so the per-sample path takes no locks.
+     *
+     * Anomaly semantics: a reading is an anomaly if it differs by more than two
+     * degrees from the previous accepted reading of the same hour, in file order.
+     * A thread cannot see what earlier segments accepted for the hour it starts
+     * in, so it keeps that hour's readings unfiltered in headSamples, and the
+     * merge replays them after everything the earlier segments accepted for that
+     * hour. Every other hour is filtered locally. For chronologically ordered
+     * logs this matches a single sequential scan exactly, and headSamples never
+     * holds more than one hour of readings.
+     *
+     * A segment whose hours go back, or that starts before the previous one
+     * ended, is marked unordered and its readings are dropped. If that happens
+     * anywhere, runSegments reads the input again in one sequential aggregate,
+     * which filters every hour as it goes.
+     */
+    struct SegmentAggregate {
+        HourlyStore<HourBucket> dataset;     // Filtered readings of every hour except the head hour
+        vector<HourExtreme> extremes;        // Running extremes of dataset's hours, in the order they were reached
+        bool hasHead;                        // False until the segment has seen a reading
+        int headHour;                        // Hour number (HourlyStore::hourIndex) of the first reading
+        vector<double> headSamples;          // Unfiltered readings of headHour
+        int lastHour;                        // Hour number of the latest reading
+        bool ordered;                        // False once an hour went back; the aggregate is then empty
+        bool sequential;                     // Filters every hour at once; only for one pass over the whole input
+
+        SegmentAggregate() : hasHead(false), headHour(0), lastHour(0), ordered(true), sequential(false) {}
+    };
+
     // Struct to hold arguments for thread functions
     struct ThreadArgs {
-        long startPosition;         // Start position for this thread
-        long endPosition;           // End position for this thread
+        vector<pair<long, long>> ranges; // Byte ranges for this thread in file order (block ranges for a columnar cache)
         int threadId;              // ID for the thread
         TemperatureAnalysis* analysis;  // Pointer to TemperatureAnalysis instance
+        SegmentAggregate aggregate;     // Readings gathered by this thread
+    };
+
+    // Struct to hold arguments for merge threads
+    struct MergeArgs {
+        TemperatureAnalysis* analysis;
+        SegmentAggregate* left;     // Earlier segment(s), receives the result
+        SegmentAggregate* right;    // Following segment(s), emptied by the merge
     };
 
     struct ReportArgs {
@@ -73,14 +147,21 @@ public:
 
     /**
      * Processes temperature data from a log file in parallel using multiple threads.
-     * Each thread handles a segment of the file, parsing temperature records and
-     * updating the shared dataset with average temperature values for each hour.
+     * Each thread handles a segment of the file, parsing temperature records into
+     * its own SegmentAggregate. The aggregates are then merged pairwise in a tree
+     * and the merged dataset is kept for the report. Only per-hour summaries are
+     * kept, so memory does not grow with the size of the log.
      *
      * **Partitioning**: The data is divided into segments based on file size, 
-     * and each thread processes its own segment.
+     * and each thread processes its own segment. Segment boundaries are moved
+     * up front to the next line start, so every line is read by exactly one thread.
      * 
      * **Load Balancing**: File size is divided evenly among threads by assigning 
-     * an equal number of bytes to each thread's segment.
+     * an equal number of bytes to each thread's segment. With setMonthIndex only
+     * the bytes of heating and cooling months are divided.
+     *
+     * The file may also be a columnar cache written by convertLogToColumnar,
+     * which is recognised by its header and read by processColumnarData.
      */
     void processTemperatureData(void);
 
@@ -96,6 +177,37 @@ public:
     void setHeatingMonths(const vector<int>& months);
     void setCoolingMonths(const vector<int>& months);
 
+    /**
+     * Selects how segments are read by processTemperatureData. Defaults to READER_MMAP.
+     * @param mode - READER_STREAM, READER_MMAP or READER_PREAD
+     */
+    void setReaderMode(ReaderMode mode);
+
+    /**
+     * Reads only the heating and cooling months of a text log, found with the
+     * log's sidecar LogIndex. The sidecar is built by the first run that
+     * needs it. Off by default.
+     */
+    void setMonthIndex(bool enabled);
+
+    /**
+     * Number of threads reading the input. Defaults to 12.
+     * @param count - at least 1
+     */
+    void setThreads(int count);
+
+    /**
+     * Splits byte ranges of a file into parts segments of about the same
+     * number of bytes, cutting only at line starts. Segments never overlap,
+     * even when a line is longer than a segment.
+     * @arg file - the open input, used to find line starts
+     * @arg ranges - byte ranges to split, in file order, each starting at a line start
+     * @arg parts - number of segments to return
+     */
+    static vector<vector<pair<long, long>>> splitRanges(const PreadFile &file,
+                                                        const vector<pair<uint64_t, uint64_t>> &ranges,
+                                                        int parts);
+
 private:
     /**
      * Used to initialize and open the file
@@ -122,19 +234,163 @@ private:
      */
     TemperatureData parseLine(const string &line);
 
+    /**
+     * Same as parseLine(const string&) but reads the record straight out of a
+     * buffer (e.g. the mapped file) without allocating.
+     * @arg line - first character of the record
+     * @arg length - number of characters in the record, excluding the newline
+     * @retval struct defined in TemperatureAnalysis.h which holds date, time, temperature
+     */
+    TemperatureData parseLine(const char *line, size_t length);
+
+    /**
+     * Applies the month filter and anomaly check to one parsed reading and
+     * records it in the thread's aggregate.
+     * @arg data - parsed reading
+     * @arg aggregate - aggregate of the calling thread
+     */
+    void addSample(const TemperatureData &data, SegmentAggregate &aggregate);
+
+    /**
+     * Applies the anomaly check to one reading of a wanted month and records
+     * it in the thread's aggregate. A reading from an earlier hour than the
+     * one before it marks the aggregate unordered (see SegmentAggregate).
+     * @arg current_hour - hour number of the reading (HourlyStore::hourIndex)
+     * @arg temperature - the reading
+     * @arg aggregate - aggregate of the calling thread
+     */
+    void addReading(int current_hour, double temperature, SegmentAggregate &aggregate);
+
+    /**
+     * Whether readings of a month are kept for the report.
+     * @arg month - month number, 1 to 12
+     */
+    bool isReportMonth(int month) const;
+
+    /**
+     * Adds an accepted reading to its hour's bucket, and to extremes if it
+     * is a new maximum or minimum of the hour.
+     * @arg bucket - summary of the accepted readings of the hour
+     * @arg hour - hour number of the reading
+     * @arg temperature - the reading
+     * @arg extremes - running extremes of the aggregate holding the bucket
+     */
+    static void acceptSample(HourBucket &bucket, int hour, double temperature, vector<HourExtreme> &extremes);
+
+    /**
+     * Adds readings to an hour, dropping each one that is an anomaly
+     * relative to the last reading accepted before it.
+     * @arg hour - hour number of the readings
+     * @arg pending - unfiltered readings, in file order
+     * @arg aggregate - aggregate holding the hour
+     */
+    void replaySamples(int hour, const vector<double> &pending, SegmentAggregate &aggregate);
+
+    /**
+     * First running maximum of an hour above threshold, or first running
+     * minimum below it, from extremes.
+     * @arg hour - hour number
+     * @arg high - true to look at the maxima, false for the minima
+     * @retval the reading, or NULL if there is none
+     */
+    const HourExtreme *firstExtreme(int hour, bool high, double threshold) const;
+
+    /**
+     * Merges the aggregate of the following segment(s) into the preceding one.
+     * The right head hour is replayed against what the left side accepted.
+     * @arg left - earlier segment(s), receives the result
+     * @arg right - following segment(s), emptied by the merge
+     */
+    void mergeAggregates(SegmentAggregate &left, SegmentAggregate &right);
+
+    /**
+     * Reads a columnar cache instead of the text log. Threads get equal runs
+     * of blocks; blocks the month index shows to hold no heating or cooling
+     * month are skipped.
+     */
+    void processColumnarData(void);
+
+    /**
+     * Heating and cooling months, the only ones the report looks at.
+     */
+    vector<int> reportMonths() const;
+
+    /**
+     * Runs one thread per segment, then merges their aggregates into dataset.
+     * @arg segments - ranges of each thread, byte offsets or block numbers, in file order
+     */
+    void runSegments(const vector<vector<pair<long, long>>> &segments);
+
+    /**
+     * Thread function for one pairwise merge, passed to pthread_create.
+     * @param args Pointer to MergeArgs
+     * @return NULL
+     */
+    static void* mergeThreadFunction(void* args);
+
     /**
      * Processes a segment of the temperature data from the input file.
      * 
      * **Partitioning**: Each thread works on its own segment of the file, 
      * with clear start and end positions to avoid overlap.
      *
-     * **Coordination**: Mutexes are used to control access to shared data structures (dataset and hourlyAvg).
+     * **Coordination**: Each thread writes only to its own aggregate, so no locks are taken.
      * 
      * @param args Pointer to ThreadArgs struct containing the start and end positions for processing.
      * @return NULL
      */
     void* processSegment(void* args);
 
+    /**
+     * Reads byte ranges (block ranges for a columnar cache) in order into one
+     * aggregate with the configured reader. Stops early once the aggregate is
+     * marked unordered.
+     */
+    void processRanges(const vector<pair<long, long>> &ranges, SegmentAggregate &aggregate);
+
+    /**
+     * Marks an aggregate unordered and frees what it gathered, which only a
+     * sequential pass can place correctly.
+     */
+    void dropUnordered(SegmentAggregate &aggregate);
+
+    /**
+     * Reads a segment through an ifstream of the calling thread (READER_STREAM).
+     * Segments start and end at line boundaries.
+     */
+    void processStreamSegment(long startPos, long endPos, SegmentAggregate &aggregate);
+
+    /**
+     * Reads a segment out of the mapped file (READER_MMAP). Segments start and
+     * end at line boundaries. Lines are decoded in blocks by parseLogBlock.
+     */
+    void processMappedSegment(long startPos, long endPos, SegmentAggregate &aggregate);
+
+    /**
+     * Reads a segment with pread (READER_PREAD), a buffer of whole lines at a
+     * time; the unfinished line at the end of a read moves to the front of the
+     * buffer for the next one. Segments start and end at line boundaries.
+     */
+    void processPreadSegment(long startPos, long endPos, SegmentAggregate &aggregate);
+
+    /**
+     * Decodes a block of whole lines with parseLogBlock and adds every reading.
+     * @arg batch - decode buffer of the calling thread, reused between blocks
+     */
+    void addBlock(const char *data, size_t length, LogBatch &batch, SegmentAggregate &aggregate);
+
+    /**
+     * Decodes a run of blocks of the columnar cache and adds every reading.
+     * @arg firstBlock - first block of the segment
+     * @arg endBlock - one past the last block of the segment
+     */
+    void processColumnarSegment(long firstBlock, long endBlock, SegmentAggregate &aggregate);
+
+    /**
+     * Adds every reading of a decoded batch, in order.
+     */
+    void addBatch(const LogBatch &batch, SegmentAggregate &aggregate);
+
     /**
      * Thread function to process a segment of the temperature data from the input file.
      * This function is static, allowing it to be passed to pthread_create.
@@ -150,7 +406,7 @@ private:
      * 
      * Load Balancing: Each month’s data is processed independently in its own thread, balancing the workload.
      * 
-     * Communication: Access to shared data (hourlyAvg, dataset, and report file) requires locking for consistency.
+     * Communication: dataset is only read here; the report file requires locking for consistency.
      * 
      * Coordination: Mutexes are used to synchronize access to shared data during report writing.
      */
@@ -163,7 +419,7 @@ private:
     * 
     * Load Balancing: Each month has its own thread, balancing work across months.
     * 
-    * Communication: Threads access shared data (e.g., `hourlyAvg` and `dataset`), requiring careful access with locks.
+    * Communication: Threads only read `dataset`; writes to the report file require careful access with locks.
     * 
     * Coordination: Mutexes ensure thread-safe reporting, allowing threads to safely write to the report file.
     */
@@ -172,16 +428,22 @@ private:
 
 
     // Private instantiation of input file field
+    string filename;
     ifstream inputFile;
-    map<hourlyData, vector<double>> dataset;
-    // Data set which contains all the parsed file data
-    map<hourlyData, tuple<double, int>> hourlyAvg;
+    MappedFile mappedFile;
+    PreadFile preadFile;
+    ColumnarLog columnarLog;
+    vector<char> selectedBlocks; // Blocks of columnarLog holding a heating or cooling month
+    ReaderMode readerMode;
+    bool useMonthIndex;
+    // Summaries of all the parsed file data, one bucket per hour
+    HourlyStore<HourBucket> dataset;
+    // Running extremes of dataset's hours, sorted by hour
+    vector<HourExtreme> extremes;
     // Holds each month's mean and standard deviation
     tuple<double, double> monthlyData[12];
 
-    // Mutexes to ensure no write errors
-    mutex datasetMutex;
-    mutex hourlyAvgMutex;
+    // Mutex to ensure no write errors in the report
     pthread_mutex_t reportMutex;
 
     // File characteristics
@@ -2,7 +2,9 @@
 
 using namespace std;
 
-TemperatureAnalysisParallel::TemperatureAnalysisParallel(const string &filename) : inputFile(filename) {}
+TemperatureAnalysisParallel::TemperatureAnalysisParallel(const string &filename)
+    : readQueue(QUEUE_CAPACITY), parseQueue(QUEUE_CAPACITY), processQueue(QUEUE_CAPACITY), filename(filename),
+      readsInFlight(READS_IN_FLIGHT), decompressionThreads(max(thread::hardware_concurrency(), 1u)) {}
 
 // Set the months designated for heating
 void TemperatureAnalysisParallel::setHeatingMonths(const vector<int> &months)
@@ -16,10 +18,40 @@ void TemperatureAnalysisParallel::setCoolingMonths(const vector<int> &months)
     coolingMonths = months;
 }
 
+// Bound the memory held between stages: a producer blocks once this many chunks are waiting for its consumer.
+// Must be called before startPipeline.
+void TemperatureAnalysisParallel::setQueueCapacity(size_t chunks)
+{
+    readQueue.setCapacity(chunks);
+    parseQueue.setCapacity(chunks);
+    processQueue.setCapacity(chunks);
+}
+
+// Number of chunk reads the reader keeps in flight; 0 reads each chunk with a plain pread when it is needed.
+// Must be called before startPipeline.
+void TemperatureAnalysisParallel::setReadsInFlight(unsigned reads)
+{
+    readsInFlight = reads;
+}
+
+// Number of zstd frames of a compressed input decompressed at the same time by the reader.
+// Must be called before startPipeline.
+void TemperatureAnalysisParallel::setDecompressionThreads(unsigned threads)
+{
+    decompressionThreads = threads;
+}
+
 // Partitioning & Scheduling: Each pipeline stage (file reading, parsing, anomaly detection, and writing) is
 // divided into separate tasks, running concurrently. Scheduling is done by launching dedicated threads.
 void TemperatureAnalysisParallel::startPipeline(const string &outputFile)
 {
+    // A columnar cache is decoded by the parser straight out of the mapping; there is no text to read
+    if (ColumnarLog::isColumnarFile(filename) && !columnarLog.open(filename))
+    {
+        cerr << "Error opening columnar cache: " << filename << endl;
+        exit(EXIT_FAILURE); // Its bytes are no text log either
+    }
+
     // Create threads for each stage of the pipeline to achieve task parallelism
     thread readerThread(&TemperatureAnalysisParallel::fileReader, this);
     thread parserThread(&TemperatureAnalysisParallel::parser, this);
@@ -31,231 +63,306 @@ void TemperatureAnalysisParallel::startPipeline(const string &outputFile)
     parserThread.join();
     processorThread.join();
     writerThread.join();
+
+    // Show where the pipeline waited: a producer blocked on a full queue is ahead of the stage after it
+    reportQueue("readQueue", readQueue);
+    reportQueue("parseQueue", parseQueue);
+    reportQueue("processQueue", processQueue);
+    columnarLog.close();
+}
+
+// Prints the backpressure counters of one inter-stage queue
+template <typename T>
+void TemperatureAnalysisParallel::reportQueue(const char *name, const SpscQueue<T> &queue)
+{
+    printf("%s (capacity %zu): producer blocked %lld times for %lld microseconds, consumer waited %lld times for %lld microseconds\n",
+           name, queue.capacity(),
+           queue.producerWaits().waits, queue.producerWaits().microseconds,
+           queue.consumerWaits().waits, queue.consumerWaits().microseconds);
 }
 
 // Stage 1: Reads data from the file and pushes to readQueue
-// Coordination & Synchronization: Protects access to readQueue with readMutex and notifies the parser when new data is available.
+// Coordination & Synchronization: The file is read in CHUNK_SIZE blocks with readsInFlight reads running ahead
+// of the parser (io_uring, or pread without it). Each block is cut back to its last line break so the parser
+// only ever sees complete lines; the partial line is carried into the headroom in front of the next block.
+// A .gz or .zst input is decompressed here instead, into blocks that go through the same carrying.
+// An input that cannot be opened or an archive that fails to decode ends the program with an error.
 void TemperatureAnalysisParallel::fileReader()
 {
-    string line;
-    while (getline(inputFile, line))
+    if (columnarLog.isOpen())
     {
-        // Synchronization: Locking the readMutex ensures thread-safe access to readQueue
-        unique_lock<mutex> lock(readMutex);
-        readQueue.push(line);
-        readCond.notify_one(); // Notify parser thread that new data is available
+        // The parser decodes the mapped blocks itself; just let the kernel read ahead for it
+        columnarLog.adviseSequential(0, columnarLog.blockCount());
+        readQueue.close();
+        printf("finished reading with mmap of the columnar cache... (STEP 1)\n");
+        return;
     }
+
+    AsyncFileReader file;
+    CompressedReader archive;
+    bool compressed = CompressedReader::detect(filename) != COMPRESSION_NONE;
+    bool opened = compressed ? archive.open(filename, CHUNK_SIZE, decompressionThreads, LINE_HEADROOM)
+                             : file.open(filename, CHUNK_SIZE, readsInFlight, LINE_HEADROOM);
+    if (!opened)
     {
-        // Send a sentinel value to signal completion of reading
-        unique_lock<mutex> lock(readMutex);
-        readQueue.push("-1");
-        readCond.notify_one();
-        printf("finished reading... (STEP 1)\n");
+        cerr << "Error opening file: " << filename << endl;
+        exit(EXIT_FAILURE); // An empty report would look like a log without findings
     }
-    inputFile.close();
-}
 
-// Stage 2: Parses each line into TemperatureData and pushes to parseQueue
-// Coordination & Synchronization: Waits for data in readQueue, signaling the anomaly detector after parsing each line.
-void TemperatureAnalysisParallel::parser()
-{
-    while (true)
+    string carry; // Start of a line that continues in the next block
+    string block;
+    while (compressed ? archive.next(block) : file.next(block))
     {
-        // Coordination: Wait until there is data available to parse
-        unique_lock<mutex> lock(readMutex);
-        readCond.wait(lock, [this]
-                      { return !readQueue.empty(); });
+        TextChunk chunk;
+        if (carry.size() <= LINE_HEADROOM)
+        {
+            chunk.begin = LINE_HEADROOM - carry.size();
+            memcpy(&block[chunk.begin], carry.data(), carry.size());
+            chunk.text.swap(block);
+        }
+        else
+        {
+            // A line longer than the headroom: copy the block behind it
+            chunk.begin = 0;
+            chunk.text.swap(carry);
+            chunk.text.append(block, LINE_HEADROOM, string::npos);
+        }
+        carry.clear();
 
-        // Check for sentinel value before processing
-        if (readQueue.empty())
+        // Keep the trailing partial line back
+        const char *start = chunk.text.data() + chunk.begin;
+        const char *lastBreak = (const char *)memrchr(start, '\n', chunk.text.size() - chunk.begin);
+        if (lastBreak == NULL)
         {
+            carry.assign(start, chunk.text.size() - chunk.begin); // A single line longer than a chunk; keep reading
             continue;
         }
+        carry.assign(lastBreak + 1, chunk.text.data() + chunk.text.size());
+        chunk.text.resize(lastBreak + 1 - chunk.text.data());
+        readQueue.push(move(chunk));
+    }
 
-        auto line = readQueue.front();
-        readQueue.pop();
-        lock.unlock(); // Unlock for other threads to access
+    if (compressed && !archive.good())
+    {
+        exit(EXIT_FAILURE); // A corrupt or truncated archive; the reason is already printed
+    }
 
-        // Check for sentinel after finished reading file
-        if (line == "-1")
-        {
-            break; // Exit loop if sentinel is found
-        }
+    // The file does not end with a line break
+    if (!carry.empty())
+    {
+        readQueue.push({move(carry), 0});
+    }
+
+    // Signal completion of reading
+    readQueue.close();
+    if (compressed)
+    {
+        printf("finished reading with %s decompression... (STEP 1)\n", archive.format() == COMPRESSION_GZIP ? "gzip" : "zstd");
+    }
+    else
+    {
+        printf("finished reading with %s... (STEP 1)\n", file.usesIoUring() ? "io_uring" : "pread");
+    }
+}
 
-        TemperatureData data = parseLine(line);
-        if (data.month == INT_MAX)
+// Stage 2: Parses chunks into LogBatches and pushes to parseQueue
+// Coordination & Synchronization: Each chunk of whole lines is decoded with parseLogBlock and the
+// resulting columnar batch is handed to the anomaly detector as one item. For a columnar cache
+// each block is decoded out of the mapping into one batch instead.
+void TemperatureAnalysisParallel::parser()
+{
+    for (size_t i = 0; i < columnarLog.blockCount(); ++i)
+    {
+        LogBatch batch;
+        if (!columnarLog.decodeBlock(i, batch))
         {
-            continue; // Skip invalid month
+            cerr << "Corrupt block " << i << " in " << filename << endl;
+            exit(EXIT_FAILURE); // A report without its readings would be wrong without saying so
         }
-
-        // Synchronization: Locking the parseMutex ensures thread-safe access to parseQueue
-        unique_lock<mutex> parseLock(parseMutex);
-        parseQueue.push(data);
-        parseCond.notify_one(); // Notify anomaly detector that new data is available
+        parseQueue.push(move(batch));
     }
 
-    // Push sentinel value to indicate completion
+    TextChunk chunk;
+
+    // Coordination: Wait until there is data available to parse
+    while (readQueue.pop(chunk))
     {
-        unique_lock<mutex> lock(parseMutex);
-        parseQueue.push(TemperatureData()); // Push an invalid TemperatureData as sentinel
-        parseCond.notify_one();
+        LogBatch batch;
+        parseLogBlock(chunk.text.data() + chunk.begin, chunk.text.size() - chunk.begin, batch);
+        if (batch.size() > 0)
+        {
+            parseQueue.push(move(batch));
+        }
     }
 
+    // Signal completion of parsing
+    parseQueue.close();
+
     printf("ALL DONE PARSE QUEUE METHOD (STEP 2)\n");
 }
 
-// Stage 3: Processes each TemperatureData for anomalies and pushes to processQueue
-// Partitioning, Load Balancing, & Synchronization: Each month’s data is processed in separate threads, ensuring balanced load.
-// Protects processQueue with processMutex.
+// Stage 3: Processes each record for anomalies and pushes to processQueue
+// Partitioning, Load Balancing, & Synchronization: Each finished month is handed to a fixed pool of evaluation
+// workers, ensuring balanced load without creating a thread per month.
+// This thread is the only producer for processQueue: it publishes each month's findings, in month order, once ready.
 void TemperatureAnalysisParallel::anomalyDetector()
 {
-    vector<thread> threads; // Container for threads evaluating monthly data
-    unordered_map<Month, unordered_map<Hour, vector<double>>> monthlyData;
+    ThreadPool evaluationPool;                         // Workers shared by all monthly evaluations
+    deque<future<vector<TemperatureDataOut>>> pending; // Monthly evaluations in month order
+    unordered_map<Month, MonthSummary> monthlyData;
     unordered_map<Hour, double> lastTemperature; // Tracks the last temperature per Hour
+    LogBatch batch;
+    LogRecord data;
 
     Month currentMonth(-1, -1); // Initialize to an invalid month
 
-    while (true)
+    // Coordination: Wait until there is data available to process
+    while (parseQueue.pop(batch))
     {
-        // Coordination: Wait until there is data available to process
-        unique_lock<mutex> lock(parseMutex);
-        parseCond.wait(lock, [this]
-                       { return !parseQueue.empty(); });
-
-        auto data = parseQueue.front();
-        parseQueue.pop();
-        lock.unlock();
-
-        // Check for sentinel value to terminate processing
-        if (data.month == 0 && data.day == 0 && data.year == 0)
+        for (size_t i = 0; i < batch.size(); ++i)
         {
-            break; // Exit the loop if sentinel is found
-        }
+            batch.get(i, data);
 
-        Month monthKey(data.year, data.month);
-        Hour hourKey(data.day, data.hour);
+            Month monthKey(data.year, data.month);
+            Hour hourKey(data.day, data.hour);
 
-        // Detect anomaly based on the last temperature
-        if (lastTemperature.find(hourKey) != lastTemperature.end())
-        {
-            double previousTemp = lastTemperature[hourKey];
-            if (isAnomaly(data.temperature, previousTemp))
+            // Detect anomaly based on the last temperature
+            auto last = lastTemperature.find(hourKey);
+            if (last != lastTemperature.end() && isAnomaly(data.temperature, last->second))
             {
                 continue; // Skip this entry as it's an anomaly
             }
-        }
 
-        // Store the current temperature
-        lastTemperature[hourKey] = data.temperature;                // Track the last temperature for this Hour
-        monthlyData[monthKey][hourKey].push_back(data.temperature); // Store temperature by month and hour
+            // Store the current temperature
+            lastTemperature[hourKey] = data.temperature;          // Track the last temperature for this Hour
+            monthlyData[monthKey].add(hourKey, data.temperature); // Summarize temperature by month and hour
 
-        // Check if the month has changed
-        if (currentMonth.month != data.month || currentMonth.year != data.year)
-        {
-            // Partitioning & Load Balancing: Each month’s data is evaluated in a new thread to ensure balanced processing
-            if (currentMonth.month != -1)
+            // Check if the month has changed
+            if (currentMonth.month != data.month || currentMonth.year != data.year)
             {
-                threads.push_back(thread(&TemperatureAnalysisParallel::evaluateMonthlyTemperatures,
-                                         this, currentMonth, monthlyData[currentMonth]));
+                // Partitioning & Load Balancing: The finished month moves into an evaluation task and is dropped here
+                auto finished = monthlyData.find(currentMonth);
+                if (finished != monthlyData.end())
+                {
+                    pending.push_back(evaluationPool.submit(bind(&TemperatureAnalysisParallel::evaluateMonthlyTemperatures,
+                                                                 this, currentMonth, move(finished->second))));
+                    monthlyData.erase(finished);
+                }
+
+                // Reset for the new month
+                lastTemperature.clear(); // Clear last temperature data
+                currentMonth = monthKey;
             }
-
-            // Reset for the new month
-            lastTemperature.clear(); // Clear last temperature data
-            currentMonth = monthKey;
         }
+
+        // Hand over the findings of months that are already evaluated
+        publishEvaluations(pending, false);
     }
 
-    // Join all threads before finishing
-    for (auto &t : threads)
+    // Wait for all evaluations before finishing
+    publishEvaluations(pending, true);
+
+    // Signal completion of processing
+    processQueue.close();
+
+    printf("ALL DONE ANOMALY DETECT METHOD (STEP 3)\n");
+}
+
+// Publishes the findings of finished monthly evaluations to processQueue, oldest month first.
+// Without waitForAll it stops at the first month that is still being evaluated.
+void TemperatureAnalysisParallel::publishEvaluations(deque<future<vector<TemperatureDataOut>>> &pending, bool waitForAll)
+{
+    while (!pending.empty())
     {
-        if (t.joinable())
+        if (!waitForAll && pending.front().wait_for(chrono::seconds(0)) != future_status::ready)
         {
-            t.join(); // Ensure all threads complete before proceeding
+            break;
         }
-    }
 
-    // Push sentinel value to indicate completion of processing
-    unique_lock<mutex> lock(processMutex);
-    processQueue.push(TemperatureDataOut()); // Push an invalid TemperatureDataOut as sentinel
-    processCond.notify_all();
-
-    printf("ALL DONE ANOMALY DETECT METHOD (STEP 3)\n");
+        vector<TemperatureDataOut> findings = pending.front().get();
+        pending.pop_front();
+        if (!findings.empty())
+        {
+            processQueue.push(move(findings));
+        }
+    }
 }
 
 // Function to calculate mean and standard deviation and evaluate temperatures
 // Partitioning: Data is processed month by month, reducing contention across threads.
-// Synchronization: Uses processMutex to ensure safe access to processQueue.
-void TemperatureAnalysisParallel::evaluateMonthlyTemperatures(Month month, const std::unordered_map<Hour, std::vector<double>> &temperatures)
+// Synchronization: Findings are returned to the anomaly detector, which publishes them to processQueue.
+vector<TemperatureDataOut> TemperatureAnalysisParallel::evaluateMonthlyTemperatures(Month month, const MonthSummary &summary)
 {
+    vector<TemperatureDataOut> findings;
+
     // Partitioning: Ensures that data for each month is evaluated separately
-    if (temperatures.empty())
+    if (summary.stats.count == 0)
     {
-        return; // No data to process
+        return findings; // No data to process
     }
 
-    // Calculate mean and standard deviation
-    double mean = calculateMean(temperatures);
-    double stddev = calculateStdDev(temperatures, mean);
+    // Mean and sample standard deviation of the month
+    double mean = summary.stats.mean;
+    double stddev = sqrt(summary.stats.sampleVariance());
 
     // Process temperatures for heating/cooling issues
-    for (const auto &hourEntry : temperatures)
+    for (const auto &hourEntry : summary.hours)
     {
         const Hour &hourKey = hourEntry.first; // Extract hour key
         int currentHour = hourKey.hour;        // Access the hour
         int currentDay = hourKey.day;          // Extract day
 
-        for (double temp : hourEntry.second)
+        // The first reading of the hour that is too warm (heating) or too cold (cooling)
+        const ExceedanceCandidates::Extreme *issue = NULL;
+        if (isHeatingMonth(month.month))
         {
-            // Synchronization: Use processMutex to ensure safe writing to the processQueue
-            if ((isHeatingMonth(month.month) && temp > mean + stddev) || (isCoolingMonth(month.month) && temp < mean - stddev))
+            issue = hourEntry.second.firstAbove(mean + stddev);
+        }
+        if (isCoolingMonth(month.month))
+        {
+            const ExceedanceCandidates::Extreme *low = hourEntry.second.firstBelow(mean - stddev);
+            if (low != NULL && (issue == NULL || low->position < issue->position))
             {
-                TemperatureDataOut data(month.month, currentDay, month.year, currentHour, 0, 0, temp, mean, stddev);
-
-                unique_lock<mutex> processLock(processMutex);
-                processQueue.push(data);  // Push detected issue to the queue
-                processCond.notify_one(); // Notify writer thread that new data is available
-                break;                    // Stop processing after first issue in this hour
+                issue = low;
             }
         }
+
+        if (issue != NULL)
+        {
+            findings.push_back(TemperatureDataOut(month.month, currentDay, month.year, currentHour, 0, 0, issue->value, mean, stddev));
+        }
     }
+
+    return findings;
 }
 
 // Stage 4: Writes results to the output file
-// Coordination & Synchronization: Waits for data in processQueue and synchronizes access with processMutex to safely write to the file.
+// Coordination & Synchronization: Consumes the findings of one month at a time from processQueue.
 void TemperatureAnalysisParallel::fileWriter(const string &outputFile)
 {
     ofstream outFile(outputFile);
-    while (true)
-    {
-        // Coordination: Wait until there are results to write
-        unique_lock<mutex> lock(processMutex);
-        processCond.wait(lock, [this]
-                         { return !processQueue.empty(); });
-
-        TemperatureDataOut result = processQueue.front();
-        processQueue.pop();
-        lock.unlock();
-
-        // Check for sentinel value to terminate
-        if (result.month == 0 && result.day == 0 && result.year == 0)
-        {
-            break; // Exit the loop if sentinel is found
-        }
+    vector<TemperatureDataOut> results;
 
-        // Format and write the result to the output file
-        if (isHeatingMonth(result.month))
-        {
-            outFile << "Heating issue detected: "
-                    << result.month << "/" << result.day << "/" << result.year
-                    << " At Hour: " << result.hour << " | Temp: " << result.temperature
-                    << " | Mean: " << result.mean << " | Stddev: " << result.stddev << endl;
-        }
-        else if (isCoolingMonth(result.month))
+    // Coordination: Wait until there are results to write
+    while (processQueue.pop(results))
+    {
+        for (const TemperatureDataOut &result : results)
         {
-            outFile << "Cooling issue detected: "
-                    << result.month << "/" << result.day << "/" << result.year
-                    << " At Hour: " << result.hour << " | Temp: " << result.temperature
-                    << " | Mean: " << result.mean << " | Stddev: " << result.stddev << endl;
+            // Format and write the result to the output file
+            if (isHeatingMonth(result.month))
+            {
+                outFile << "Heating issue detected: "
+                        << result.month << "/" << result.day << "/" << result.year
+                        << " At Hour: " << result.hour << " | Temp: " << result.temperature
+                        << " | Mean: " << result.mean << " | Stddev: " << result.stddev << endl;
+            }
+            else if (isCoolingMonth(result.month))
+            {
+                outFile << "Cooling issue detected: "
+                        << result.month << "/" << result.day << "/" << result.year
+                        << " At Hour: " << result.hour << " | Temp: " << result.temperature
+                        << " | Mean: " << result.mean << " | Stddev: " << result.stddev << endl;
+            }
         }
 
         // Flush the output to ensure it's written immediately
@@ -265,63 +372,6 @@ void TemperatureAnalysisParallel::fileWriter(const string &outputFile)
     outFile.close();
 }
 
-// Helper function to parse a line of data
-TemperatureData TemperatureAnalysisParallel::parseLine(const string &line)
-{
-    stringstream ss(line);
-    char delim{};
-
-    int month, day, year, hour, minute, second;
-    float temperature;
-
-    if (line.empty())
-    {
-        return TemperatureData(INT_MAX, 0, 0, 0, 0, 0, 0.0); // Return an invalid TemperatureData
-    }
-
-    // Parse the line
-    ss >> month >> delim >> day >> delim >> year >> hour >> delim >> minute >> delim >> second >> temperature;
-
-    // Return structured data
-    return TemperatureData(month, day, year, hour, minute, second, temperature);
-}
-
-// Helper function to calculate mean temperature
-double TemperatureAnalysisParallel::calculateMean(const unordered_map<Hour, vector<double>> &temperatures)
-{
-    double total = 0;
-    int count = 0;
-
-    for (const auto &hourEntry : temperatures)
-    {
-        for (double temp : hourEntry.second)
-        {
-            total += temp;
-            count++;
-        }
-    }
-
-    return (count > 0) ? (total / count) : 0;
-}
-
-// Helper function to calculate standard deviation
-double TemperatureAnalysisParallel::calculateStdDev(const unordered_map<Hour, vector<double>> &temperatures, double mean)
-{
-    double sumSquaredDiffs = 0;
-    int count = 0;
-
-    for (const auto &hourEntry : temperatures)
-    {
-        for (double temp : hourEntry.second)
-        {
-            sumSquaredDiffs += (temp - mean) * (temp - mean);
-            count++;
-        }
-    }
-
-    return (count > 1) ? sqrt(sumSquaredDiffs / (count - 1)) : 0; // Using sample std dev
-}
-
 // Helper function to determine if temperature is an anomaly
 bool TemperatureAnalysisParallel::isAnomaly(double current, double previous)
 {
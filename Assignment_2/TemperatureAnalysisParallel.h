@@ -1,35 +1,31 @@
 #ifndef TEMPERATURE_ANALYSIS_PARALLEL_H
 #define TEMPERATURE_ANALYSIS_PARALLEL_H
 
-#include <condition_variable>
 #include <cmath>
 #include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <future>
 #include <iostream>
-#include <mutex>
-#include <queue>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 #include <limits.h>
+#include "AsyncFileReader.h"
+#include "ColumnarLog.h"
+#include "CompressedReader.h"
+#include "LogBatch.h"
+#include "LogParser.h"
+#include "RunningStats.h"
+#include "SpscQueue.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
-struct TemperatureData
-{
-    int month, day, year, hour, minute, second;
-    double temperature;
-    bool isValid; // Indicates if the data is valid
-
-    TemperatureData(int m, int d, int y, int h, int mi, int s, double temp)
-        : month(m), day(d), year(y), hour(h), minute(mi), second(s), temperature(temp), isValid(true) {}
-
-    TemperatureData() : month(0), day(0), year(0), hour(0), minute(0), second(0), temperature(0), isValid(false) {} // Default constructor for sentinel
-};
-
 struct TemperatureDataOut
 {
     int month;
@@ -46,7 +42,7 @@ struct TemperatureDataOut
     TemperatureDataOut(int m, int d, int y, int h, int mi, int s, double temp, double meanVal = 0.0, double stddevVal = 0.0)
         : month(m), day(d), year(y), hour(h), minute(mi), second(s), temperature(temp), mean(meanVal), stddev(stddevVal) {}
 
-    // Sentinel constructor
+    // Default constructor
     TemperatureDataOut()
         : month(0), day(0), year(0), hour(0), minute(0), second(0),
           temperature(0.0), mean(0.0), stddev(0.0) {}
@@ -109,6 +105,29 @@ namespace std
     };
 }
 
+// Streaming summary of one month: statistics over all accepted readings and, per
+// hour, the running extremes needed to find the first reading outside
+// mean +/- stddev once the month is complete. No raw readings are kept.
+struct MonthSummary
+{
+    RunningStats stats;
+    unordered_map<Hour, ExceedanceCandidates> hours;
+
+    void add(const Hour &hour, double temperature)
+    {
+        stats.add(temperature);
+        hours[hour].add(temperature);
+    }
+};
+
+// Whole lines handed from the reader to the parser: text[begin, text.size()). The reader puts the
+// unfinished last line of the previous block in front of a block's data, so the block is never moved.
+struct TextChunk
+{
+    string text;
+    size_t begin;
+};
+
 // Class to perform temperature analysis in a task-parallel pipeline
 class TemperatureAnalysisParallel
 {
@@ -116,20 +135,33 @@ public:
     TemperatureAnalysisParallel(const string &filename);
     void setHeatingMonths(const vector<int> &months);
     void setCoolingMonths(const vector<int> &months);
+    void setQueueCapacity(size_t chunks);
+    void setReadsInFlight(unsigned reads);
+    void setDecompressionThreads(unsigned threads);
     void startPipeline(const string &outputFile);
 
 private:
-    // Queue to store data between stages
-    queue<string> readQueue;
-    queue<TemperatureData> parseQueue;
-    queue<TemperatureDataOut> processQueue;
-
-    // Mutexes and condition variables for each stage
-    mutex readMutex, parseMutex, processMutex;
-    condition_variable readCond, parseCond, processCond;
+    // Bytes of input per chunk handed from the reader to the parser
+    static const size_t CHUNK_SIZE = 1 << 20;
+    // Default number of chunks (or batches derived from them) in flight between two stages
+    static const size_t QUEUE_CAPACITY = 8;
+    // Default number of chunk reads the reader keeps in flight
+    static const unsigned READS_IN_FLIGHT = 4;
+    // Room in front of each chunk for the end of the previous chunk's last line
+    static const size_t LINE_HEADROOM = 4096;
+
+    // Single-producer/single-consumer rings between consecutive stages. Each item is a whole
+    // chunk: a block of complete lines, the records decoded from one block, or the findings of
+    // one month. The producer closes its ring to signal the end of the stream.
+    SpscQueue<TextChunk> readQueue;
+    SpscQueue<LogBatch> parseQueue;
+    SpscQueue<vector<TemperatureDataOut>> processQueue;
 
     // File handling and configuration variables
-    ifstream inputFile;
+    string filename;
+    ColumnarLog columnarLog; // Mapped when the input is a columnar cache instead of a text log
+    unsigned readsInFlight;
+    unsigned decompressionThreads;
     vector<int> heatingMonths, coolingMonths;
 
     // Stage functions to handle each part of the pipeline
@@ -139,13 +171,13 @@ private:
     void fileWriter(const string &outputFile);
 
     // Helper functions
-    TemperatureData parseLine(const string &line);
     bool isAnomaly(double currentTemp, double previousTemp);
-    double calculateMean(const std::unordered_map<Hour, std::vector<double>> &temperatures);
-    double calculateStdDev(const std::unordered_map<Hour, std::vector<double>> &temperatures, double mean);
-    void evaluateMonthlyTemperatures(Month month, const std::unordered_map<Hour, std::vector<double>> &temperatures);
+    vector<TemperatureDataOut> evaluateMonthlyTemperatures(Month month, const MonthSummary &summary);
+    void publishEvaluations(deque<future<vector<TemperatureDataOut>>> &pending, bool waitForAll);
     bool isCoolingMonth(int month);
     bool isHeatingMonth(int month);
+    template <typename T>
+    void reportQueue(const char *name, const SpscQueue<T> &queue);
 };
 
 #endif // TEMPERATURE_ANALYSIS_PARALLEL_H
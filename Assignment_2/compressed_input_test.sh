@@ -0,0 +1,42 @@
+#!/bin/bash
+# Checks that the pipeline reads a .gz log like the text log, and exits with an error instead of
+# writing a report when the archive is missing or truncated.
+# usage: compressed_input_test.sh <program>
+PROGRAM=$(realpath "$1")
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+# Five days of January and July readings every 10 seconds
+awk 'BEGIN {
+    srand(3)
+    for (m = 1; m <= 7; m += 6) for (d = 1; d <= 5; d++) for (s = 0; s < 86400; s += 10) {
+        printf "%02d/%02d/04 %02d:%02d:%02d %.1f\n", m, d, int(s / 3600), int(s / 60) % 60, s % 60, (m == 7 ? 80 : 30) + rand() * 4
+    }
+}' > sample.log
+gzip -k sample.log
+head -c $(($(stat -c %s sample.log.gz) / 2)) sample.log.gz > truncated.log.gz
+
+failures=0
+
+"$PROGRAM" sample.log > /dev/null || exit 1
+sort outputData.log > expected.txt
+rm outputData.log
+if ! "$PROGRAM" sample.log.gz > /dev/null || ! sort outputData.log | cmp -s - expected.txt; then
+    echo "sample.log.gz is not reported like sample.log"
+    failures=$((failures + 1))
+fi
+
+for input in truncated.log.gz missing.log.gz missing.log.zst; do
+    rm -f outputData.log
+    if "$PROGRAM" $input > /dev/null 2>&1; then
+        echo "$input was read without an error"
+        failures=$((failures + 1))
+    fi
+done
+
+if [ $failures -eq 0 ]; then
+    echo "compressed input: all cases passed"
+fi
+[ $failures -eq 0 ]
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include "LogParser.h"
+#include "LogBatch.h"
+
+// Checks which dates parseLogLine accepts: days past the end of their month are malformed.
+// parseLogBlock, whose vector path decodes the date columns itself, must agree line by line.
+// Readings must also keep their exact value, sign of zero included, through the tenths encoding.
+
+struct DateCase {
+    const char *line;
+    ParseStatus expected;
+};
+
+static const DateCase CASES[] = {
+    {"02/28/04 10:00:00 71.0", PARSE_OK},
+    {"02/29/04 10:00:00 71.0", PARSE_OK},         // 2004 is a leap year
+    {"02/29/00 10:00:00 71.0", PARSE_OK},         // so is 2000
+    {"02/29/05 10:00:00 71.0", PARSE_MALFORMED},
+    {"02/30/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"02/31/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"04/30/04 10:00:00 71.0", PARSE_OK},
+    {"04/31/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"06/31/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"09/31/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"11/31/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"12/31/04 23:59:59 71.0", PARSE_OK},
+    {"01/32/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"00/10/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"13/10/04 10:00:00 71.0", PARSE_MALFORMED},
+    {"03/00/04 10:00:00 71.0", PARSE_MALFORMED},
+};
+
+// Readings that must survive the tenths encoding of the wire records and the columnar cache
+static const double TENTHS_CASES[] = {0.0, -0.0, 0.1, -0.1, -1.0, 71.3, -3276.7, 3276.7};
+
+// Returns true if parseLogBlock decodes line exactly as parseLogLine does
+static bool blockMatchesLine(const char *line) {
+    LogRecord expected;
+    ParseStatus status = parseLogLine(line, strlen(line), expected);
+
+    LogBatch batch;
+    std::string block = std::string(line) + "\n";
+    parseLogBlock(block.data(), block.size(), batch);
+    if (status != PARSE_OK) {
+        return batch.size() == 0 && batch.malformed == 1;
+    }
+    if (batch.size() != 1 || batch.malformed != 0) {
+        return false;
+    }
+    return batch.timestamps[0] == packTimestamp(expected) && batch.temperatures[0] == expected.temperature;
+}
+
+int main() {
+    int failures = 0;
+    for (const DateCase &test : CASES) {
+        LogRecord record;
+        ParseStatus status = parseLogLine(test.line, strlen(test.line), record);
+        if (status != test.expected) {
+            std::cerr << "\"" << test.line << "\" parsed as " << status << ", expected " << test.expected
+                      << std::endl;
+            failures++;
+        }
+        if (!blockMatchesLine(test.line)) {
+            std::cerr << "parseLogBlock decodes \"" << test.line << "\" differently from parseLogLine" << std::endl;
+            failures++;
+        }
+    }
+
+    for (double temperature : TENTHS_CASES) {
+        int16_t tenths;
+        double back = 0.0;
+        if (temperatureToTenths(temperature, tenths)) {
+            back = tenthsToTemperature(tenths);
+        }
+        if (memcmp(&back, &temperature, sizeof(double)) != 0) {
+            std::cerr << "Temperature " << temperature << " (sign " << std::signbit(temperature)
+                      << ") comes back from tenths as " << back << " (sign " << std::signbit(back) << ")" << std::endl;
+            failures++;
+        }
+    }
+
+    if (failures == 0) {
+        std::cout << "log parser: all cases passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
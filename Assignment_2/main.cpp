@@ -3,12 +3,28 @@
 #include <sys/time.h>
 #include "TemperatureAnalysisParallel.h"
 
-int main() {
+// Usage: run [input]                  analyse input (a text log, a .gz/.zst of one, or a columnar cache), bigw12a.log by default
+//        run --convert <log> <cache>   write the columnar cache of a text log once, for later runs to read
+int main(int argc, char *argv[]) {
     struct timeval start, end;
 
     std::string filename = "bigw12a.log";
     std::string outputFile = "outputData.log";
 
+    if (argc >= 4 && std::string(argv[1]) == "--convert") {
+        gettimeofday(&start, NULL);
+        if (!convertLogToColumnar(argv[2], argv[3])) {
+            return 1;
+        }
+        gettimeofday(&end, NULL);
+        printf("Converted %s to columnar cache %s in %ld microseconds\n", argv[2], argv[3],
+               (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_usec - start.tv_usec));
+        return 0;
+    }
+    if (argc >= 2) {
+        filename = argv[1];
+    }
+
     printf("Initialize File and Setup Pipeline\n");
     gettimeofday(&start, NULL); // Start timer
 
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include "TemperatureAnalysis.h"
+
+// Checks TemperatureAnalysis::splitRanges on a log whose middle line is longer than a segment
+static const char *TEST_LOG = "split_ranges_test.log";
+
+// Returns true if every cut is a line start, no byte is read twice and every byte of ranges is read once
+static bool checkSegments(const std::string &text, const std::vector<std::pair<uint64_t, uint64_t>> &ranges,
+                          const std::vector<std::vector<std::pair<long, long>>> &segments, int parts)
+{
+    if ((int)segments.size() != parts) {
+        std::cerr << "Expected " << parts << " segments, got " << segments.size() << std::endl;
+        return false;
+    }
+
+    long previous = 0;
+    long covered = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        for (const auto &range : segments[i]) {
+            if (range.first >= range.second || range.first < previous) {
+                std::cerr << "Segment " << i << " has range [" << range.first << ", " << range.second
+                          << ") after " << previous << std::endl;
+                return false;
+            }
+            if (range.first > 0 && text[range.first - 1] != '\n') {
+                std::cerr << "Segment " << i << " starts inside a line at " << range.first << std::endl;
+                return false;
+            }
+            previous = range.second;
+            covered += range.second - range.first;
+        }
+    }
+
+    long expected = 0;
+    for (const auto &range : ranges) {
+        expected += range.second - range.first;
+    }
+    if (covered != expected) {
+        std::cerr << "Segments cover " << covered << " bytes, expected " << expected << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    // Short lines, one line of 5000 bytes, then short lines again; the file is about 6 KiB
+    std::string text;
+    for (int i = 0; i < 20; ++i) {
+        text += "2004-01-01 00:00:00,1.0\n";
+    }
+    size_t secondRange = text.size();
+    text += std::string(5000, 'x') + "\n";
+    size_t thirdRange = text.size();
+    for (int i = 0; i < 20; ++i) {
+        text += "2004-01-01 01:00:00,2.0\n";
+    }
+
+    std::ofstream out(TEST_LOG, std::ios::binary);
+    out << text;
+    out.close();
+
+    PreadFile file;
+    if (!file.open(TEST_LOG)) {
+        std::cerr << "Could not open " << TEST_LOG << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+
+    // The whole file as one range, and split into several ranges as the month index returns them
+    std::vector<std::vector<std::pair<uint64_t, uint64_t>>> cases;
+    cases.push_back({std::make_pair((uint64_t)0, (uint64_t)text.size())});
+    cases.push_back({std::make_pair((uint64_t)0, (uint64_t)secondRange),
+                     std::make_pair((uint64_t)secondRange, (uint64_t)thirdRange),
+                     std::make_pair((uint64_t)thirdRange, (uint64_t)text.size())});
+    cases.push_back({std::make_pair((uint64_t)24, (uint64_t)thirdRange),
+                     std::make_pair((uint64_t)(thirdRange + 48), (uint64_t)text.size())});
+
+    for (const auto &ranges : cases) {
+        for (int parts = 1; parts <= 16; ++parts) {
+            if (!checkSegments(text, ranges, TemperatureAnalysis::splitRanges(file, ranges, parts), parts)) {
+                std::cerr << "Failed with " << ranges.size() << " range(s) and " << parts << " parts" << std::endl;
+                failures++;
+            }
+        }
+    }
+
+    file.close();
+    std::remove(TEST_LOG);
+
+    if (failures == 0) {
+        std::cout << "splitRanges: all cases passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include "TemperatureAnalysis.h"
+
+// Checks that TemperatureAnalysis reports an unordered log the way it reports the same readings
+// sorted by hour: the anomaly filter only depends on the order of readings within each hour
+
+static const char *SHUFFLED_LOG = "unordered_log_test_shuffled.log";
+static const char *SWAPPED_LOG = "unordered_log_test_swapped.log";
+static const char *SORTED_LOG = "unordered_log_test_sorted.log";
+static const char *REPORT = "unordered_log_test_report.txt";
+
+// Readings every 20 seconds over a few days of January, May and July, with spikes the filter drops
+static std::vector<std::string> makeReadings() {
+    std::vector<std::string> lines;
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> step(-0.6, 0.6);
+    std::uniform_int_distribution<int> spike(0, 40);
+    const int months[] = {1, 5, 7};
+    for (int month : months) {
+        double temperature = (month == 7) ? 80.0 : 30.0;
+        for (int day = 1; day <= 4; ++day) {
+            for (int second = 0; second < 24 * 3600; second += 20) {
+                temperature += step(random);
+                double reading = temperature + (spike(random) == 0 ? 5.0 : 0.0);
+                char line[64];
+                snprintf(line, sizeof(line), "%02d/%02d/04 %02d:%02d:%02d %.1f\n", month, day,
+                         second / 3600, (second / 60) % 60, second % 60, reading);
+                lines.push_back(line);
+            }
+        }
+    }
+    return lines;
+}
+
+static void writeLog(const char *name, const std::vector<std::string> &lines) {
+    std::ofstream out(name, std::ios::binary);
+    for (const std::string &line : lines) {
+        out << line;
+    }
+}
+
+// "MM/DD/YY HH" reordered so that comparing strings compares hours
+static std::string hourKey(const std::string &line) {
+    return line.substr(6, 2) + line.substr(0, 2) + line.substr(3, 2) + line.substr(9, 2);
+}
+
+// Report lines of one run, sorted since the month threads write them in any order
+static std::vector<std::string> report(const char *log, int threads, TemperatureAnalysis::ReaderMode mode) {
+    {
+        TemperatureAnalysis analysis(log);
+        analysis.setHeatingMonths({12, 1, 2, 3});
+        analysis.setCoolingMonths({7, 8, 9});
+        analysis.setThreads(threads);
+        analysis.setReaderMode(mode);
+        analysis.processTemperatureData();
+        analysis.generateReport(REPORT);
+    }
+
+    std::vector<std::string> lines;
+    std::ifstream in(REPORT);
+    std::string line;
+    while (getline(in, line)) {
+        lines.push_back(line);
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+int main() {
+    std::vector<std::string> readings = makeReadings();
+
+    std::vector<std::string> shuffled(readings);
+    std::mt19937 random(11);
+    std::shuffle(shuffled.begin(), shuffled.end(), random);
+    writeLog(SHUFFLED_LOG, shuffled);
+
+    // Ordered within each half, but the second half comes first
+    std::vector<std::string> swapped(readings.begin() + readings.size() / 2, readings.end());
+    swapped.insert(swapped.end(), readings.begin(), readings.begin() + readings.size() / 2);
+    writeLog(SWAPPED_LOG, swapped);
+
+    int failures = 0;
+    const char *logs[] = {SHUFFLED_LOG, SWAPPED_LOG};
+    for (const char *log : logs) {
+        // The same readings in hour order, keeping their order within each hour
+        std::vector<std::string> sorted(log == SHUFFLED_LOG ? shuffled : swapped);
+        std::stable_sort(sorted.begin(), sorted.end(), [](const std::string &a, const std::string &b) {
+            return hourKey(a) < hourKey(b);
+        });
+        writeLog(SORTED_LOG, sorted);
+
+        std::vector<std::string> expected = report(SORTED_LOG, 12, TemperatureAnalysis::READER_MMAP);
+        if (expected.empty()) {
+            std::cerr << "The sorted log of " << log << " reported nothing" << std::endl;
+            failures++;
+        }
+
+        const TemperatureAnalysis::ReaderMode modes[] = {TemperatureAnalysis::READER_STREAM,
+                                                         TemperatureAnalysis::READER_MMAP,
+                                                         TemperatureAnalysis::READER_PREAD};
+        for (TemperatureAnalysis::ReaderMode mode : modes) {
+            for (int threads : {1, 3, 12}) {
+                if (report(log, threads, mode) != expected) {
+                    std::cerr << log << " with " << threads << " threads and reader mode " << mode
+                              << " differs from its hour-sorted log" << std::endl;
+                    failures++;
+                }
+            }
+        }
+    }
+
+    std::remove(SHUFFLED_LOG);
+    std::remove(SWAPPED_LOG);
+    std::remove(SORTED_LOG);
+    std::remove(REPORT);
+
+    if (failures == 0) {
+        std::cout << "unordered logs: all cases passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+#ifndef SHARED_RING_H
+#define SHARED_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+using namespace std;
+
+// Single-producer single-consumer ring of variable-length messages in memory that two processes of
+// one node share (an MPI shared-memory window). The sender builds each message in place in the ring
+// and publishes it by advancing tail; the receiver reads it in place and frees it by advancing head.
+// Handing a batch to the next stage therefore copies nothing beyond packing it.
+//
+// Messages are 8-byte aligned and never wrap around: when one does not fit before the end of the
+// ring, a RING_WRAP marker sends the receiver back to the start. Neither side blocks; the link
+// classes decide how to wait.
+class SharedRing {
+public:
+    enum Kind {
+        RING_DATA = 0,    // A batch
+        RING_WRAP = 1,    // Nothing more before the end of the ring, continue at the start
+        RING_END = 2,     // The sender has finished
+        RING_REDIRECT = 3 // The next batch was too large for the ring and comes as an MPI message
+    };
+
+    // Bytes of shared memory a ring with capacity bytes for messages occupies
+    static size_t footprint(size_t capacity) { return sizeof(Control) + capacity; }
+
+    SharedRing() : control(NULL), data(NULL), capacity(0), reserved(0), pending(0) {}
+
+    // memory: footprint(capacity) bytes aligned to 64; capacity: a multiple of 8
+    SharedRing(char *memory, size_t capacity)
+        : control((Control *)memory), data(memory + sizeof(Control)), capacity(capacity), reserved(0), pending(0) {}
+
+    // Run once by the process owning the memory, before either side uses the ring
+    void initialize() { new (control) Control(); }
+
+    // Largest batch the ring takes; larger ones have to travel another way
+    size_t maxMessage() const { return capacity / 2 - sizeof(Header); }
+
+    // Sender: space for a batch of count bytes, or NULL while the ring is too full
+    char *tryReserve(size_t count) {
+        uint64_t tail = control->tail.load(memory_order_relaxed);
+        size_t need = sizeof(Header) + align(count);
+        size_t offset = tail % capacity;
+        size_t skip = (capacity - offset < need) ? capacity - offset : 0;
+        if (tail + skip + need - control->head.load(memory_order_acquire) > capacity) {
+            return NULL;
+        }
+
+        if (skip > 0) {
+            header(offset) = {RING_WRAP, 0};
+            tail += skip;
+            control->tail.store(tail, memory_order_release);
+        }
+        reserved = tail;
+        return data + tail % capacity + sizeof(Header);
+    }
+
+    // Sender: publishes the first count bytes of the space tryReserve returned as a batch
+    void publish(size_t count) { publishAs(RING_DATA, count); }
+
+    // Sender: publishes an empty message of the given kind; false while the ring is full
+    bool tryPublishMarker(Kind kind) {
+        if (tryReserve(0) == NULL) {
+            return false;
+        }
+        publishAs(kind, 0);
+        return true;
+    }
+
+    // Receiver: the next message, if one has been published. Its bytes stay valid until release().
+    bool peek(Kind &kind, const char *&message, size_t &count) {
+        uint64_t head = control->head.load(memory_order_relaxed);
+        while (head != control->tail.load(memory_order_acquire)) {
+            size_t offset = head % capacity;
+            const Header &next = header(offset);
+            if (next.kind == RING_WRAP) {
+                head += capacity - offset;
+                control->head.store(head, memory_order_release);
+                continue;
+            }
+
+            kind = (Kind)next.kind;
+            count = next.count;
+            message = data + offset + sizeof(Header);
+            pending = sizeof(Header) + align(count);
+            return true;
+        }
+        return false;
+    }
+
+    // Receiver: frees the message returned by peek() for the sender to reuse
+    void release() {
+        control->head.store(control->head.load(memory_order_relaxed) + pending, memory_order_release);
+        pending = 0;
+    }
+
+private:
+    struct Header {
+        int32_t kind;
+        int32_t count;
+    };
+
+    // Lives at the start of the shared memory; the indices count bytes since the ring was created
+    struct Control {
+        alignas(64) atomic<uint64_t> tail; // Written by the sender only
+        alignas(64) atomic<uint64_t> head; // Written by the receiver only
+
+        Control() : tail(0), head(0) {}
+    };
+
+    static size_t align(size_t count) { return (count + 7) & ~(size_t)7; }
+
+    Header &header(size_t offset) { return *(Header *)(data + offset); }
+
+    void publishAs(Kind kind, size_t count) {
+        header(reserved % capacity) = {(int32_t)kind, (int32_t)count};
+        control->tail.store(reserved + sizeof(Header) + align(count), memory_order_release);
+    }
+
+    Control *control;
+    char *data;
+    size_t capacity;
+    uint64_t reserved; // Sender: position of the message being built
+    size_t pending;    // Receiver: bytes of the message handed out by peek()
+};
+
+#endif // SHARED_RING_H
@@ -6,177 +6,797 @@
 #include <string>
 #include <cmath>
 #include <algorithm>
+#include <cstddef>
 #include <cstring>
 #include <queue>
+#include <thread>
+#include <time.h>
+#include "LogBatch.h"
+#include "LogParser.h"
+#include "RunningStats.h"
 #include "TemperatureAnalysisMPI.h"
 
 using namespace std;
 
-// Parse a line of input
-TemperatureData TemperatureAnalysisMPI::parseLine(const string &line) {
-    stringstream ss(line);
-    char delim;
-    int month, day, year, hour, minute, second;
-    double temperature;
+// Waits for requests and adds the time spent to idle
+static void waitTimed(int count, MPI_Request *requests, double &idle) {
+    double start = MPI_Wtime();
+    MPI_Waitall(count, requests, MPI_STATUSES_IGNORE);
+    idle += MPI_Wtime() - start;
+}
+
+// Pauses before the next poll of a link: spins, then gives other processes (e.g. the other end of a
+// shared-memory ring) a chance to run, then sleeps. polls counts the polls of this wait so far.
+static void backOff(int &polls, double &since, double &idle) {
+    if (polls < BACKOFF_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else if (polls < BACKOFF_SPINS + BACKOFF_YIELDS) {
+        this_thread::yield();
+    } else {
+        struct timespec pause = {0, BACKOFF_SLEEP_NS};
+        nanosleep(&pause, NULL);
+    }
+    polls++;
+    double now = MPI_Wtime();
+    idle += now - since;
+    since = now;
+}
+
+BatchSender::BatchSender(int destination, SharedRing *ring)
+    : next(0), destination(destination), ring(ring), inRing(false), idle(0.0) {
+    for (Slot &slot : slots) {
+        slot.request = MPI_REQUEST_NULL;
+    }
+}
+
+char *BatchSender::reserve(int count) {
+    inRing = (ring != NULL && (size_t)count <= ring->maxMessage());
+    if (inRing) {
+        char *space;
+        double since = MPI_Wtime();
+        int polls = 0;
+        while ((space = ring->tryReserve(count)) == NULL) {
+            backOff(polls, since, idle);
+        }
+        return space;
+    }
+
+    // Reuse the oldest buffer once its batch has left
+    Slot &slot = slots[next];
+    waitTimed(1, &slot.request, idle);
+    slot.payload.resize(count);
+    return slot.payload.data();
+}
+
+void BatchSender::publish(int count) {
+    if (inRing) {
+        ring->publish(count);
+        return;
+    }
+
+    Slot &slot = slots[next];
+    next = (next + 1) % LINK_BUFFERS;
+    if (ring == NULL) {
+        MPI_Isend(slot.payload.data(), count, MPI_PACKED, destination, LINK_DATA, MPI_COMM_WORLD, &slot.request);
+        return;
+    }
+
+    // Too large for the ring: send it over MPI under its own tag and leave a note in the ring where it belongs
+    MPI_Isend(slot.payload.data(), count, MPI_PACKED, destination, LINK_REDIRECT, MPI_COMM_WORLD, &slot.request);
+    publishMarker(SharedRing::RING_REDIRECT);
+}
+
+void BatchSender::send(const void *data, int count) {
+    memcpy(reserve(count), data, count);
+    publish(count);
+}
 
-    if (line.empty())
-        return {-1, 0, 0, 0, 0, 0, 0.0}; // Invalid data
+void BatchSender::publishMarker(SharedRing::Kind kind) {
+    double since = MPI_Wtime();
+    int polls = 0;
+    while (!ring->tryPublishMarker(kind)) {
+        backOff(polls, since, idle);
+    }
+}
+
+void BatchSender::finish() {
+    for (Slot &slot : slots) {
+        waitTimed(1, &slot.request, idle);
+    }
+    if (ring != NULL) {
+        publishMarker(SharedRing::RING_END);
+    } else {
+        MPI_Send(NULL, 0, MPI_BYTE, destination, LINK_END, MPI_COMM_WORLD);
+    }
+}
+
+BatchReceiver::BatchReceiver(const vector<int> &sources, const vector<SharedRing *> &rings)
+    : current(0), source(MPI_ANY_SOURCE), senders(0), held(NULL), idle(0.0) {
+    for (Slot &slot : slots) {
+        slot.request = MPI_REQUEST_NULL;
+    }
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (rings[i] != NULL) {
+            this->rings.push_back(rings[i]);
+            ringSenders.push_back(sources[i]);
+        } else {
+            source = (senders == 0 && sources.size() == 1) ? sources[i] : MPI_ANY_SOURCE;
+            senders++;
+        }
+    }
+}
+
+// Posts the receive of the message status describes; false if it is a sender's end of stream
+bool BatchReceiver::post(Slot &slot, MPI_Status &status) {
+    if (status.MPI_TAG == LINK_END) {
+        MPI_Recv(NULL, 0, MPI_BYTE, status.MPI_SOURCE, LINK_END, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        senders--;
+        return false;
+    }
+
+    // Receive from the probed sender only, in case several are sending
+    int count;
+    MPI_Get_count(&status, MPI_PACKED, &count);
+    slot.payload.resize(count);
+    MPI_Irecv(slot.payload.data(), count, MPI_PACKED, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, &slot.request);
+    return true;
+}
+
+// Every sender is on another node: block in MPI and prefetch the next batch
+bool BatchReceiver::receiveOverMpi(const char *&batch, int &count) {
+    Slot &slot = slots[current];
+
+    // Unless the receive was already posted while handing out the previous batch, wait for the next message
+    while (slot.request == MPI_REQUEST_NULL) {
+        if (senders == 0) {
+            return false;
+        }
+        MPI_Status status;
+        double start = MPI_Wtime();
+        MPI_Probe(source, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        idle += MPI_Wtime() - start;
+        post(slot, status);
+    }
+    waitTimed(1, &slot.request, idle);
+
+    // Start the transfer of the next batch before the stage works on this one
+    current = (current + 1) % LINK_BUFFERS;
+    MPI_Status status;
+    int arrived = 0;
+    MPI_Iprobe(source, LINK_DATA, MPI_COMM_WORLD, &arrived, &status);
+    if (arrived) {
+        post(slots[current], status);
+    }
 
-    ss >> month >> delim >> day >> delim >> year >> hour >> delim >> minute >> delim >> second >> temperature;
-    return {month, day, year, hour, minute, second, temperature};
+    batch = slot.payload.data();
+    count = slot.payload.size();
+    return true;
+}
+
+// Receives a batch its sender on this node could not fit into the ring
+void BatchReceiver::receiveRedirected(int sender, const char *&batch, int &count) {
+    Slot &slot = slots[current];
+    current = (current + 1) % LINK_BUFFERS;
+
+    MPI_Status status;
+    MPI_Probe(sender, LINK_REDIRECT, MPI_COMM_WORLD, &status);
+    post(slot, status);
+    waitTimed(1, &slot.request, idle);
+    batch = slot.payload.data();
+    count = slot.payload.size();
+}
+
+bool BatchReceiver::receive(const char *&batch, int &count) {
+    // The stage is done with the batch it read in place
+    if (held != NULL) {
+        held->release();
+        held = NULL;
+    }
+    if (rings.empty()) {
+        return receiveOverMpi(batch, count);
+    }
+
+    // Poll the rings, and MPI for any senders on other nodes, until one of them has a batch
+    double since = MPI_Wtime();
+    int polls = 0;
+    while (!rings.empty() || senders > 0) {
+        for (size_t i = 0; i < rings.size(); ++i) {
+            SharedRing::Kind kind;
+            const char *message;
+            size_t length;
+            if (!rings[i]->peek(kind, message, length)) {
+                continue;
+            }
+
+            if (kind == SharedRing::RING_DATA) {
+                held = rings[i];
+                batch = message;
+                count = (int)length;
+                idle += MPI_Wtime() - since;
+                return true;
+            }
+
+            rings[i]->release();
+            if (kind == SharedRing::RING_REDIRECT) {
+                idle += MPI_Wtime() - since;
+                receiveRedirected(ringSenders[i], batch, count);
+                return true;
+            }
+
+            // RING_END: this sender has finished
+            rings.erase(rings.begin() + i);
+            ringSenders.erase(ringSenders.begin() + i);
+            --i;
+        }
+
+        if (senders > 0) {
+            MPI_Status status;
+            int arrived = 0;
+            // One probe for both tags, so a sender's end is never seen before its last batch. A batch a
+            // sender on this node redirected is left for receiveRedirected, once its ring note arrives.
+            MPI_Iprobe(source, MPI_ANY_TAG, MPI_COMM_WORLD, &arrived, &status);
+            if (arrived && status.MPI_TAG != LINK_REDIRECT) {
+                Slot &slot = slots[current];
+                if (post(slot, status)) {
+                    current = (current + 1) % LINK_BUFFERS;
+                    waitTimed(1, &slot.request, idle);
+                    batch = slot.payload.data();
+                    count = slot.payload.size();
+                    idle += MPI_Wtime() - since;
+                    return true;
+                }
+                continue;
+            }
+        }
+        backOff(polls, since, idle);
+    }
+    return false;
+}
+
+// Hybrid mode: decodes a block of whole lines with the thread team. The block is cut into one piece
+// per thread at line breaks, each thread decodes its piece into its own LogBatch, and the pieces
+// are appended to batch in order.
+static void parseLogBlockWithTeam(ThreadTeam &team, const char *data, size_t length, LogBatch &batch) {
+    size_t parts = min((size_t)team.size(), length / MIN_THREAD_BYTES);
+    if (parts <= 1) {
+        parseLogBlock(data, length, batch);
+        return;
+    }
+
+    // Piece i starts after the first line break at or beyond i * length / parts
+    vector<size_t> cuts(parts + 1, length);
+    cuts[0] = 0;
+    for (size_t i = 1; i < parts; ++i) {
+        const char *lineBreak = (const char *)memchr(data + i * length / parts, '\n', length - i * length / parts);
+        cuts[i] = (lineBreak == NULL) ? length : max(lineBreak + 1 - data, (ptrdiff_t)cuts[i - 1]);
+    }
+
+    vector<LogBatch> pieces(parts);
+    team.run(parts, [&](int part) {
+        parseLogBlock(data + cuts[part], cuts[part + 1] - cuts[part], pieces[part]);
+    });
+
+    for (const LogBatch &piece : pieces) {
+        batch.timestamps.insert(batch.timestamps.end(), piece.timestamps.begin(), piece.timestamps.end());
+        batch.temperatures.insert(batch.temperatures.end(), piece.temperatures.begin(), piece.temperatures.end());
+        batch.malformed += piece.malformed;
+    }
+}
+
+// Hybrid mode: decodes columnar cache blocks stored back to back from data with the thread team. Each
+// thread decodes a run of the blocks into its own LogBatch, and the runs are appended to batch in order.
+// A corrupt block aborts the run, since leaving out its records would change every statistic.
+static void decodeBlocksWithTeam(ThreadTeam &team, const vector<ColumnarBlock> &blocks, const char *data, LogBatch &batch) {
+    size_t parts = min((size_t)team.size(), blocks.size());
+    vector<LogBatch> pieces(parts);
+    vector<char> corrupt(parts, 0);
+    team.run(parts, [&](int part) {
+        for (size_t i = blocks.size() * part / parts; i < blocks.size() * (part + 1) / parts; ++i) {
+            if (!decodeColumnarBlock(blocks[i], data + (blocks[i].offset - blocks[0].offset), pieces[part])) {
+                corrupt[part] = 1;
+            }
+        }
+    });
+
+    for (size_t part = 0; part < parts; ++part) {
+        if (corrupt[part]) {
+            cerr << "Corrupt block in the columnar cache" << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        batch.timestamps.insert(batch.timestamps.end(), pieces[part].timestamps.begin(), pieces[part].timestamps.end());
+        batch.temperatures.insert(batch.temperatures.end(), pieces[part].temperatures.begin(), pieces[part].temperatures.end());
+    }
+}
+
+// Committed by the first wireRecordType() call, freed by freeWireRecordType()
+static MPI_Datatype wireType = MPI_DATATYPE_NULL;
+
+MPI_Datatype wireRecordType() {
+    if (wireType == MPI_DATATYPE_NULL) {
+        int lengths[] = {1, 1};
+        MPI_Aint offsets[] = {offsetof(WireRecord, timestamp), offsetof(WireRecord, tenths)};
+        MPI_Datatype fields[] = {MPI_UINT32_T, MPI_INT16_T};
+        MPI_Datatype record;
+        MPI_Type_create_struct(2, lengths, offsets, fields, &record);
+
+        // Step over the struct's tail padding between consecutive records in memory
+        MPI_Type_create_resized(record, 0, sizeof(WireRecord), &wireType);
+        MPI_Type_commit(&wireType);
+        MPI_Type_free(&record);
+    }
+    return wireType;
+}
+
+void freeWireRecordType() {
+    if (wireType != MPI_DATATYPE_NULL) {
+        MPI_Type_free(&wireType);
+    }
+}
+
+int16_t wireTenths(double temperature) {
+    int16_t tenths;
+    if (!temperatureToTenths(temperature, tenths)) {
+        cerr << "Temperature " << temperature << " cannot be sent in tenths of a degree (finer than 0.1 or beyond "
+             << "+/-3276.7); stopping rather than changing the statistics" << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return tenths;
+}
+
+WireRecord toWireRecord(const TemperatureData &data) {
+    WireRecord record;
+    record.timestamp = packTimestamp(data.year, data.month, data.day, data.hour, data.minute, data.second);
+    record.tenths = wireTenths(data.temperature);
+    return record;
+}
+
+TemperatureData fromWireRecord(const WireRecord &record) {
+    TemperatureData data;
+    unpackTimestamp(record.timestamp, data.year, data.month, data.day, data.hour, data.minute, data.second);
+    data.temperature = tenthsToTemperature(record.tenths);
+    return data;
+}
+
+void sendRecordBatch(BatchSender &link, const BatchHeader &header, const vector<WireRecord> &records) {
+    int headerSize, recordsSize;
+    MPI_Pack_size(1, MPI_LONG_LONG, MPI_COMM_WORLD, &headerSize);
+    MPI_Pack_size(records.size(), wireRecordType(), MPI_COMM_WORLD, &recordsSize);
+    int size = headerSize + recordsSize;
+    char *buffer = link.reserve(size);
+
+    int position = 0;
+    MPI_Pack(&header.sequence, 1, MPI_LONG_LONG, buffer, size, &position, MPI_COMM_WORLD);
+    MPI_Pack(records.data(), records.size(), wireRecordType(), buffer, size, &position, MPI_COMM_WORLD);
+    link.publish(position);
+}
+
+void unpackBatchHeader(const char *buffer, int size, BatchHeader &header, int &position) {
+    MPI_Unpack((void *)buffer, size, &position, &header.sequence, 1, MPI_LONG_LONG, MPI_COMM_WORLD);
+}
+
+void unpackRecordBatch(const char *buffer, int size, BatchHeader &header, vector<TemperatureData> &records) {
+    int position = 0;
+    unpackBatchHeader(buffer, size, header, position);
+
+    // The rest of the buffer holds whole packed records
+    int recordSize;
+    MPI_Pack_size(1, wireRecordType(), MPI_COMM_WORLD, &recordSize);
+    vector<WireRecord> wire((size - position) / recordSize);
+    MPI_Unpack((void *)buffer, size, &position, wire.data(), wire.size(), wireRecordType(), MPI_COMM_WORLD);
+
+    records.resize(wire.size());
+    for (size_t i = 0; i < wire.size(); ++i) {
+        records[i] = fromWireRecord(wire[i]);
+    }
+}
+
+BatchSizer::BatchSizer(int initialBytes, bool adaptive)
+    : current(initialBytes), adaptive(adaptive), direction(1), windowBatches(0), windowBytes(0),
+      windowStart(MPI_Wtime()), previousRate(0.0) {}
+
+void BatchSizer::record(int count) {
+    windowBytes += count;
+    if (!adaptive || ++windowBatches < ADAPT_WINDOW) {
+        return;
+    }
+
+    double now = MPI_Wtime();
+    double rate = windowBytes / max(now - windowStart, 1e-9);
+
+    // The last change made things slower: go back the other way
+    if (previousRate > 0 && rate < previousRate) {
+        direction = -direction;
+    }
+    previousRate = rate;
+    current = (direction > 0) ? min(current * 2, MAX_BATCH_BYTES) : max(current / 2, MIN_BATCH_BYTES);
+
+    windowBatches = 0;
+    windowBytes = 0;
+    windowStart = now;
 }
 
 // File reader stage
 void TemperatureAnalysisMPI::fileReader(const string &filename) {
     ifstream inputFile(filename);
-    string line;
-    vector<string> batch;
-
-    while (getline(inputFile, line)) {
-        batch.push_back(line);
-        if (batch.size() == BATCH_SIZE) {
-            // Concatenate the batch of lines into one large buffer
-            int totalSize = 0;
-            for (const auto &line : batch) {
-                totalSize += line.size() + 1; // +1 for the null terminator
-            }
+    BatchSizer sizer(batchBytes, adaptiveBatching);
 
-            // Create a buffer to hold all lines in the batch
-            char *buffer = new char[totalSize];
-            int offset = 0;
+    // One link per parser rank; batches are dealt out round-robin
+    vector<BatchSender> toParsers;
+    for (int parserRank : parserRanks()) {
+        toParsers.push_back(linkTo(parserRank));
+    }
 
-            // Copy each line into the buffer
-            for (const auto &line : batch) {
-                memcpy(buffer + offset, line.c_str(), line.size() + 1);
-                offset += line.size() + 1;
+    string line;
+    vector<char> batch; // Newline terminated lines decoded by a parser as one block
+    BatchHeader header = {0};
+    int headerSize;
+    MPI_Pack_size(1, MPI_LONG_LONG, MPI_COMM_WORLD, &headerSize);
+    long long totalBytes = 0;
+    double start = MPI_Wtime();
+
+    // Packs the batch behind its header into the next parser's link and starts a new one
+    auto sendBatch = [&]() {
+        BatchSender &toParser = toParsers[header.sequence % toParsers.size()];
+        int size = headerSize + batch.size();
+        char *packed = toParser.reserve(size);
+        int position = 0;
+        MPI_Pack(&header.sequence, 1, MPI_LONG_LONG, packed, size, &position, MPI_COMM_WORLD);
+        MPI_Pack(batch.data(), batch.size(), MPI_CHAR, packed, size, &position, MPI_COMM_WORLD);
+        toParser.publish(position);
+
+        sizer.record(batch.size());
+        totalBytes += batch.size();
+        header.sequence++;
+        batch.clear();
+    };
+
+    // A columnar cache goes out as runs of whole blocks, which the parsers decode instead of text
+    if (columnarInput) {
+        ColumnarLog cache;
+        if (!cache.open(filename)) {
+            cerr << "Could not open columnar cache " << filename << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        int countSize;
+        MPI_Pack_size(1, MPI_INT, MPI_COMM_WORLD, &countSize);
+        cache.adviseSequential(0, cache.blockCount());
+
+        for (size_t first = 0; first < cache.blockCount();) {
+            size_t last = first + 1;
+            while (last < cache.blockCount() && cache.spanBytes(first, last + 1) <= (size_t)sizer.bytes()) {
+                last++;
             }
+            int blockCount = last - first;
+            int span = cache.spanBytes(first, last);
+
+            BatchSender &toParser = toParsers[header.sequence % toParsers.size()];
+            int size = headerSize + countSize + blockCount * sizeof(ColumnarBlock) + span;
+            char *packed = toParser.reserve(size);
+            int position = 0;
+            MPI_Pack(&header.sequence, 1, MPI_LONG_LONG, packed, size, &position, MPI_COMM_WORLD);
+            MPI_Pack(&blockCount, 1, MPI_INT, packed, size, &position, MPI_COMM_WORLD);
+            MPI_Pack(&cache.block(first), blockCount * sizeof(ColumnarBlock), MPI_BYTE, packed, size, &position, MPI_COMM_WORLD);
+            MPI_Pack(cache.data() + cache.block(first).offset, span, MPI_BYTE, packed, size, &position, MPI_COMM_WORLD);
+            toParser.publish(position);
+
+            sizer.record(span);
+            totalBytes += span;
+            header.sequence++;
+            first = last;
+        }
+    }
 
-            // Send the total size of the buffer and the buffer itself
-            MPI_Send(&totalSize, 1, MPI_INT, PARSER, 0, MPI_COMM_WORLD);
-            MPI_Send(buffer, totalSize, MPI_CHAR, PARSER, 0, MPI_COMM_WORLD);
+    // A .gz or .zst log is decompressed here, frames of a multi-frame zstd file on all of the rank's threads.
+    // Lines go into batches as they are completed; the month index holds offsets of plain text, so it is not used.
+    bool compressed = !columnarInput && CompressedReader::detect(filename) != COMPRESSION_NONE;
+    if (compressed) {
+        CompressedReader archive;
+        if (!archive.open(filename, DECOMPRESS_BLOCK, threadCount, 0)) {
+            cerr << "Could not open compressed log " << filename << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        string block;
+        while (archive.next(block)) {
+            const char *cursor = block.data();
+            const char *end = cursor + block.size();
+            while (cursor < end) {
+                const char *lineBreak = (const char *)memchr(cursor, '\n', end - cursor);
+                if (lineBreak == NULL) {
+                    batch.insert(batch.end(), cursor, end); // Finished by the next block
+                    break;
+                }
+                batch.insert(batch.end(), cursor, lineBreak + 1);
+                cursor = lineBreak + 1;
+                if (batch.size() >= (size_t)sizer.bytes()) {
+                    sendBatch();
+                }
+            }
+        }
+        if (!archive.good()) {
+            MPI_Abort(MPI_COMM_WORLD, 1); // A corrupt or truncated archive; the reason is already printed
+        }
+        if (!batch.empty() && batch.back() != '\n') {
+            batch.push_back('\n');
+        }
+    }
 
-            // Clean up
-            delete[] buffer;
+    // Byte ranges of the log to read: all of it, or with the month index only the heating and cooling months
+    vector<pair<uint64_t, uint64_t>> ranges;
+    LogIndex index;
+    if (!columnarInput && !compressed) {
+        if (!inputFile.is_open()) {
+            cerr << "Could not open " << filename << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        ranges.push_back(make_pair((uint64_t)0, (uint64_t)UINT64_MAX));
+    }
+    if (!columnarInput && !compressed && useMonthIndex && index.loadOrBuild(filename)) {
+        vector<int> months(heatingMonths);
+        months.insert(months.end(), coolingMonths.begin(), coolingMonths.end());
+        ranges = index.rangesFor(months);
+    }
 
-            batch.clear();
+    for (const pair<uint64_t, uint64_t> &range : ranges) {
+        inputFile.clear();
+        inputFile.seekg(range.first);
+        uint64_t position = range.first;
+        while (position < range.second && getline(inputFile, line)) {
+            position += line.size() + 1;
+            batch.insert(batch.end(), line.begin(), line.end());
+            batch.push_back('\n');
+            if (batch.size() >= (size_t)sizer.bytes()) {
+                // Keep reading while the batch is sent
+                sendBatch();
+            }
         }
     }
 
     // Send any remaining lines
     if (!batch.empty()) {
-        int totalSize = 0;
-        for (const auto &line : batch) {
-            totalSize += line.size() + 1;
+        sendBatch();
+    }
+
+    // Signal end of file to every parser
+    double idle = 0.0;
+    for (BatchSender &toParser : toParsers) {
+        toParser.finish();
+        idle += toParser.idleSeconds();
+    }
+    double elapsed = MPI_Wtime() - start;
+    printf("read terminate (%lld bytes in %.6f s, %.1f MB/s, batch size %d bytes, %zu parsers, idle %.6f s sending)\n",
+           totalBytes, elapsed, totalBytes / elapsed / 1e6, sizer.bytes(), toParsers.size(), idle);
+}
+
+
+// Parser stage: any number of ranks can run it side by side
+void TemperatureAnalysisMPI::parser() {
+    ThreadTeam team(threadCount);
+    BatchReceiver fromReader = linkFrom(vector<int>(1, FILEREADER));
+    BatchSender toDetector = linkTo(ANOMALYDETECTOR);
+    const char *buffer;
+    int bufferSize;
+    vector<WireRecord> records;
+    vector<ColumnarBlock> blocks;
+    LogBatch batch;
+
+    while (fromReader.receive(buffer, bufferSize)) {
+        // Keep the reader's sequence number so the detector can restore file order
+        BatchHeader header;
+        int position = 0;
+        unpackBatchHeader(buffer, bufferSize, header, position);
+
+        // Decode the whole batch of newline terminated lines (or of cache blocks) in one call, where it
+        // was received; MPI_CHAR and MPI_BYTE data is packed as is
+        batch.clear();
+        if (columnarInput) {
+            int blockCount;
+            MPI_Unpack(buffer, bufferSize, &position, &blockCount, 1, MPI_INT, MPI_COMM_WORLD);
+            blocks.resize(blockCount);
+            MPI_Unpack(buffer, bufferSize, &position, blocks.data(), blockCount * sizeof(ColumnarBlock), MPI_BYTE, MPI_COMM_WORLD);
+            decodeBlocksWithTeam(team, blocks, buffer + position, batch);
+        } else {
+            parseLogBlockWithTeam(team, buffer + position, bufferSize - position, batch);
         }
 
-        char *buffer = new char[totalSize];
-        int offset = 0;
-        for (const auto &line : batch) {
-            memcpy(buffer + offset, line.c_str(), line.size() + 1);
-            offset += line.size() + 1;
+        // The decoder already produces packed timestamps, so records go straight to the wire format
+        records.resize(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            records[i].timestamp = batch.timestamps[i];
+            records[i].tenths = wireTenths(batch.temperatures[i]);
         }
 
-        MPI_Send(&totalSize, 1, MPI_INT, PARSER, 0, MPI_COMM_WORLD);
-        MPI_Send(buffer, totalSize, MPI_CHAR, PARSER, 0, MPI_COMM_WORLD);
+        // Send parsed data to anomaly detector: the BatchHeader, then the records in wire format
+        sendRecordBatch(toDetector, header, records);
+    }
+
+    // Signal end of parsing
+    toDetector.finish();
+    printf("parse terminate (idle %.6f s receiving, %.6f s sending)\n", fromReader.idleSeconds(), toDetector.idleSeconds());
+}
+
+// Ranks running the parser stage: PARSER, plus every rank above the additional evaluators
+vector<int> TemperatureAnalysisMPI::parserRanks() {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-        delete[] buffer;
+    int first = EXTRA_RANKS;
+    for (int rank : evaluatorRanks()) {
+        first = max(first, rank + 1);
     }
 
-    // Signal end of file
-    int sentinel = -1;
-    MPI_Send(&sentinel, 1, MPI_INT, PARSER, 0, MPI_COMM_WORLD);
-    printf("read terminate\n");
+    vector<int> ranks(1, PARSER);
+    for (int rank = first; rank < size; ++rank) {
+        ranks.push_back(rank);
+    }
+    return ranks;
 }
 
+// Ranks running the evaluation stage: EVALUATETEMPERATURES and, with collective output, FILEWRITER,
+// whose rank has nothing else to do then; further evaluators up to evaluatorCount come from EXTRA_RANKS
+vector<int> TemperatureAnalysisMPI::evaluatorRanks() {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-// Parser stage
-void TemperatureAnalysisMPI::parser() {
-    while (true) {
-        // Receive the total size of the batch
-        int totalSize;
-        MPI_Recv(&totalSize, 1, MPI_INT, FILEREADER, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        if (totalSize == -1) break; // End signal
-
-        // Allocate a buffer to hold all lines in the batch
-        char *buffer = new char[totalSize];
-
-        // Receive the entire batch of lines
-        MPI_Recv(buffer, totalSize, MPI_CHAR, FILEREADER, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        vector<TemperatureData> parsedData;
-
-        // Parse the received buffer into individual lines
-        int offset = 0;
-        while (offset < totalSize) {
-            // Find the end of the current line (null terminator)
-            string line(buffer + offset);
-            TemperatureData temp_line = parseLine(line);
-            if(temp_line.month != -1){
-                parsedData.push_back(parseLine(line));
-            }
-            
-            // Move the offset to the next line
-            offset += line.size() + 1; // +1 for the null terminator
+    vector<int> ranks(1, EVALUATETEMPERATURES);
+    if (collectiveOutput) {
+        ranks.push_back(FILEWRITER);
+    }
+    for (int rank = EXTRA_RANKS; (int)ranks.size() < evaluatorCount && rank < size; ++rank) {
+        ranks.push_back(rank);
+    }
+    return ranks;
+}
+
+// Every link of the pipeline as (sender, receiver); the same list on every rank
+vector<pair<int, int>> TemperatureAnalysisMPI::pipelineLinks() {
+    vector<pair<int, int>> links;
+    for (int parserRank : parserRanks()) {
+        links.push_back(make_pair((int)FILEREADER, parserRank));
+        links.push_back(make_pair(parserRank, (int)ANOMALYDETECTOR));
+    }
+    for (int evaluatorRank : evaluatorRanks()) {
+        links.push_back(make_pair((int)ANOMALYDETECTOR, evaluatorRank));
+        if (!collectiveOutput) {
+            links.push_back(make_pair(evaluatorRank, (int)FILEWRITER));
         }
+    }
+    return links;
+}
 
-        // Send parsed data to anomaly detector
-        int batchSize = parsedData.size();
-        MPI_Send(&batchSize, 1, MPI_INT, ANOMALYDETECTOR, 0, MPI_COMM_WORLD);
-        MPI_Send(parsedData.data(), batchSize * sizeof(TemperatureData), MPI_BYTE, ANOMALYDETECTOR, 0, MPI_COMM_WORLD);
+// Finds the pipeline links whose two ranks MPI_Comm_split_type puts on the same node and gives each a
+// SharedRing in an MPI_Win_allocate_shared window. Each rank's share of the window holds the rings it
+// receives on, so the receiver reads batches from its own memory.
+void TemperatureAnalysisMPI::setupSharedLinks() {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+
+    // Rank within this node of every rank, MPI_UNDEFINED for ranks on other nodes
+    MPI_Group worldGroup, nodeGroup;
+    MPI_Comm_group(MPI_COMM_WORLD, &worldGroup);
+    MPI_Comm_group(nodeComm, &nodeGroup);
+    vector<int> worldRanks(size), nodeRanks(size);
+    for (int i = 0; i < size; ++i) {
+        worldRanks[i] = i;
+    }
+    MPI_Group_translate_ranks(worldGroup, size, worldRanks.data(), nodeGroup, nodeRanks.data());
+    MPI_Group_free(&worldGroup);
+    MPI_Group_free(&nodeGroup);
+
+    // Rings follow each other in their receiver's share in link order
+    size_t ringBytes = SharedRing::footprint(SHARED_RING_BYTES);
+    vector<size_t> offsets;
+    vector<size_t> ringsOf(size, 0);
+    for (const pair<int, int> &link : pipelineLinks()) {
+        if (link.first < size && link.second < size &&
+            nodeRanks[link.first] != MPI_UNDEFINED && nodeRanks[link.second] != MPI_UNDEFINED) {
+            sharedLinks.push_back({link.first, link.second, SharedRing()});
+            offsets.push_back(ringsOf[link.second]++ * ringBytes);
+        }
+    }
 
-        // Clean up
-        delete[] buffer;
+    char *share;
+    MPI_Win_allocate_shared(ringsOf[rank] * ringBytes, 1, MPI_INFO_NULL, nodeComm, &share, &linkWindow);
+    for (size_t i = 0; i < sharedLinks.size(); ++i) {
+        SharedLink &link = sharedLinks[i];
+        MPI_Aint shareSize;
+        int unit;
+        char *receiverShare;
+        MPI_Win_shared_query(linkWindow, nodeRanks[link.receiver], &shareSize, &unit, &receiverShare);
+        link.ring = SharedRing(receiverShare + offsets[i], SHARED_RING_BYTES);
+        if (link.receiver == rank) {
+            link.ring.initialize();
+        }
     }
 
-    // Signal end of parsing
-    int sentinel = -1;
-    MPI_Send(&sentinel, 1, MPI_INT, ANOMALYDETECTOR, 0, MPI_COMM_WORLD);
-    printf("parse terminate\n");
+    // No sender may touch a ring before its receiver has initialized it
+    MPI_Barrier(nodeComm);
+}
+
+void TemperatureAnalysisMPI::releaseSharedLinks() {
+    if (linkWindow != MPI_WIN_NULL) {
+        MPI_Win_free(&linkWindow);
+        MPI_Comm_free(&nodeComm);
+    }
+    sharedLinks.clear();
+}
+
+// The ring of the link from sender to receiver, or NULL if they are on different nodes
+SharedRing *TemperatureAnalysisMPI::sharedRing(int sender, int receiver) {
+    for (SharedLink &link : sharedLinks) {
+        if (link.sender == sender && link.receiver == receiver) {
+            return &link.ring;
+        }
+    }
+    return NULL;
+}
+
+BatchSender TemperatureAnalysisMPI::linkTo(int receiver) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return BatchSender(receiver, sharedRing(rank, receiver));
+}
+
+BatchReceiver TemperatureAnalysisMPI::linkFrom(const vector<int> &senders) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    vector<SharedRing *> rings;
+    for (int sender : senders) {
+        rings.push_back(sharedRing(sender, rank));
+    }
+    return BatchReceiver(senders, rings);
 }
 
 
 // Anomaly detector stage
 void TemperatureAnalysisMPI::anomalyDetector()
 {
-    queue<TemperatureData> parseQueue;
+    // Batches arrive from every parser rank, not necessarily in file order
+    BatchReceiver fromParsers = linkFrom(parserRanks());
+    BatchReorder fileOrder;
+    const char *buffer;
+    int bufferSize;
     vector<TemperatureData> sendBuffer;
 
-    // Initialize currentMonth and previousTemp
-    int currentMonth = -1;  // Use -1 as an uninitialized value
-    double previousTemp = -1;  // Use -1 as an uninitialized value
+    // One link per evaluator rank; each finished month goes to the evaluator its (year, month) hashes to
+    vector<BatchSender> toEvaluators;
+    for (int evaluatorRank : evaluatorRanks()) {
+        toEvaluators.push_back(linkTo(evaluatorRank));
+    }
+    vector<WireRecord> monthRecords;
+    BatchHeader monthHeader = {0};
+    vector<TemperatureData> dataBatch;
 
-    while (true)
+    // Ships the month collected in sendBuffer, numbered so the writer can keep month order
+    auto sendMonth = [&]()
     {
-        // Receive batch size
-        int batchSize;
-        MPI_Recv(&batchSize, 1, MPI_INT, PARSER, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        if (batchSize == -1) {
-            // send remaining monthly data from sendbuffer
-            int totalDataSize = sendBuffer.size();  // Update the size of the sendBuffer
-            if(totalDataSize > 0) {
-                MPI_Send(&totalDataSize, 1, MPI_INT, EVALUATETEMPERATURES, 0, MPI_COMM_WORLD);
-                // Send the data in sendBuffer (ensure we are sending the right number of elements)
-                MPI_Send(sendBuffer.data(), totalDataSize * sizeof(TemperatureData), MPI_BYTE, EVALUATETEMPERATURES, 0, MPI_COMM_WORLD);
-            }
-            break; // End signal
+        monthRecords.resize(sendBuffer.size());
+        for (size_t i = 0; i < sendBuffer.size(); ++i) {
+            monthRecords[i] = toWireRecord(sendBuffer[i]);
         }
+        int key = sendBuffer[0].year * 12 + sendBuffer[0].month;
+        sendRecordBatch(toEvaluators[key % toEvaluators.size()], monthHeader, monthRecords);
+        monthHeader.sequence++;
+    };
 
-        // Create a vector to hold the received data batch
-        vector<TemperatureData> dataBatch(batchSize); // Create a batch of the correct size
-
-        // Receive the entire batch of TemperatureData
-        MPI_Recv(dataBatch.data(), batchSize * sizeof(TemperatureData), MPI_BYTE, PARSER, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Initialize currentMonth and previousTemp
+    int currentMonth = -1;  // Use -1 as an uninitialized value
+    double previousTemp = -1;  // Use -1 as an uninitialized value
 
-        // Push the newly received data to the parseQueue
-        for (const auto& data : dataBatch) {
-            parseQueue.push(data);
-        }
+    // Runs the detector over one batch; batches must be handed over in file order
+    auto processBatch = [&](const char *batch, int size)
+    {
+        BatchHeader header;
+        unpackRecordBatch(batch, size, header, dataBatch);
+        size_t batchSize = dataBatch.size();
 
-        // Process the data in the queue
-        while (!parseQueue.empty())
+        // Process the data in the batch
+        for (size_t i = 0; i < batchSize; ++i)
         {
-            auto data = parseQueue.front();
-            parseQueue.pop();
+            const TemperatureData &data = dataBatch[i];
 
             // Handle edge case for first temperature and month
             if (previousTemp == -1) { // Assume -1 means uninitialized
@@ -190,10 +810,8 @@ void TemperatureAnalysisMPI::anomalyDetector()
             // Check if current month is same as previous month
             // If it isn't, send data and set current month and previous value to equal current value, clear sendbuffer
             if (data.month != currentMonth) {
-                int totalDataSize = sendBuffer.size();  // Update the size of the sendBuffer
-                if (totalDataSize > 0) {
-                    MPI_Send(&totalDataSize, 1, MPI_INT, EVALUATETEMPERATURES, 0, MPI_COMM_WORLD);
-                    MPI_Send(sendBuffer.data(), totalDataSize * sizeof(TemperatureData), MPI_BYTE, EVALUATETEMPERATURES, 0, MPI_COMM_WORLD);
+                if (!sendBuffer.empty()) {
+                    sendMonth();
                 }
                 // Update current month and reset previousTemp
                 currentMonth = data.month;
@@ -216,40 +834,57 @@ void TemperatureAnalysisMPI::anomalyDetector()
             }
 
         }
+    };
+
+    while (fromParsers.receive(buffer, bufferSize))
+    {
+        fileOrder.push(buffer, bufferSize, processBatch);
     }
 
-    // Send sentinel value to indicate the end of processing
-    int endSignal = -1;
-    MPI_Send(&endSignal, 1, MPI_INT, EVALUATETEMPERATURES, 0, MPI_COMM_WORLD); // Send end signal to terminate the next stage
-    printf("anomaly terminate\n");
+    // send remaining monthly data from sendbuffer
+    if (!sendBuffer.empty()) {
+        sendMonth();
+    }
+
+    // Send end signal to terminate the next stage
+    double idle = 0.0;
+    for (BatchSender &toEvaluator : toEvaluators) {
+        toEvaluator.finish();
+        idle += toEvaluator.idleSeconds();
+    }
+    printf("anomaly terminate (idle %.6f s receiving, %.6f s sending)\n", fromParsers.idleSeconds(), idle);
 }
 
 
 
 
-void TemperatureAnalysisMPI::evaluateMonthlyTemperatures(void)
+// Evaluation stage: any number of ranks can run it side by side, each taking its share of the months.
+// With collective output each evaluator formats the findings of its months itself and the evaluators
+// write them to outputFile together at the end; otherwise the findings go to the writer rank.
+void TemperatureAnalysisMPI::evaluateMonthlyTemperatures(const string &outputFile)
 {
-    // Local variable to track processed hours
-    set<int> processedHours;
+    ThreadTeam team(threadCount);
+    BatchReceiver fromDetector = linkFrom(vector<int>(1, ANOMALYDETECTOR));
+    BatchSender toWriter = linkTo(FILEWRITER);
+    const char *buffer;
+    int bufferSize;
     vector<TemperatureData> sendBuffer;
+    vector<WireRecord> findingRecords;
+    vector<TemperatureData> data;
 
-    while (true) {
-        // Receive the batch size of the data
-        int batchSize;
-        MPI_Recv(&batchSize, 1, MPI_INT, ANOMALYDETECTOR, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Collective output: this rank's report lines, month after month, and each month's number and length
+    string report;
+    vector<long long> monthSequences, monthBytes;
+    ostringstream monthReport;
 
-        if (batchSize <= 0) {
-            cerr << "Received invalid batchSize: " << batchSize << endl;
-            break; // Handle gracefully or exit
-        }
-
-        // Receive chunk of monthly temperature data (clean of anomalies)
-        vector<TemperatureData> data(batchSize);
-        MPI_Recv(data.data(), batchSize * sizeof(TemperatureData), MPI_BYTE, ANOMALYDETECTOR, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Receive chunks of monthly temperature data (clean of anomalies)
+    while (fromDetector.receive(buffer, bufferSize)) {
+        BatchHeader header;
+        unpackRecordBatch(buffer, bufferSize, header, data);
 
         // Calculate mean and standard deviation for the current month's data
-        double mean = calculateMean(data);
-        double stddev = calculateStdDev(data, mean);
+        double mean = calculateMean(data, team);
+        double stddev = calculateStdDev(data, mean, team);
         printf("Month: %d\t Mean: %f\t STDV: %f\n", data[0].month, mean, stddev);
         // Process temperatures for heating/cooling issues
 
@@ -277,24 +912,112 @@ void TemperatureAnalysisMPI::evaluateMonthlyTemperatures(void)
 
         }
 
-        // Send buffer via MPI to FileWriter
-        if(!sendBuffer.empty()){
-            int totalDataSize = sendBuffer.size();  // Get the size of the sendBuffer
-            MPI_Send(&totalDataSize, 1, MPI_INT, FILEWRITER, 0, MPI_COMM_WORLD);  // Send the size to FileWriter
-            if (totalDataSize > 0) {
-                MPI_Send(sendBuffer.data(), totalDataSize * sizeof(TemperatureData), MPI_BYTE, FILEWRITER, 0, MPI_COMM_WORLD);  // Send data to FileWriter
+        if (collectiveOutput) {
+            monthReport.str("");
+            for (const TemperatureData &entry : sendBuffer) {
+                formatFinding(monthReport, entry);
+            }
+            string text = monthReport.str();
+            report += text;
+            monthSequences.push_back(header.sequence);
+            monthBytes.push_back(text.size());
+        } else {
+            // Send buffer via MPI to FileWriter under the month's number, even when empty, so the writer can keep month order
+            findingRecords.resize(sendBuffer.size());
+            for (size_t i = 0; i < sendBuffer.size(); ++i) {
+                findingRecords[i] = toWireRecord(sendBuffer[i]);
             }
+            sendRecordBatch(toWriter, header, findingRecords);
         }
-        processedHours.clear();
 
         // Clear sendBuffer after sending
         sendBuffer.clear();
-        data.clear();
     }
 
-    int endSignal = -1;
-    MPI_Send(&endSignal, 1, MPI_INT, FILEWRITER, 0, MPI_COMM_WORLD); // Send end signal to terminate the next stage
-    printf("eval terminate\n");
+    if (collectiveOutput) {
+        double start = MPI_Wtime();
+        writeReportCollectively(outputFile, report, monthSequences, monthBytes);
+        printf("eval terminate (idle %.6f s receiving, %.6f s writing)\n", fromDetector.idleSeconds(), MPI_Wtime() - start);
+        return;
+    }
+
+    // Send end signal to terminate the next stage
+    toWriter.finish();
+    printf("eval terminate (idle %.6f s receiving, %.6f s sending)\n", fromDetector.idleSeconds(), toWriter.idleSeconds());
+}
+
+// Collective output: writes the findings of every evaluator to outputFile in month order. The
+// evaluators exchange the number and length of each of their months, which tells every rank where
+// its months go in the file; then each writes all of its months in one collective call through a
+// file view that covers just those ranges.
+void TemperatureAnalysisMPI::writeReportCollectively(const string &outputFile, const string &report,
+                                                     const vector<long long> &sequences, const vector<long long> &lengths)
+{
+    vector<int> evaluators = evaluatorRanks();
+    MPI_Group worldGroup, evaluatorGroup;
+    MPI_Comm_group(MPI_COMM_WORLD, &worldGroup);
+    MPI_Group_incl(worldGroup, evaluators.size(), evaluators.data(), &evaluatorGroup);
+    MPI_Comm evaluatorComm;
+    MPI_Comm_create_group(MPI_COMM_WORLD, evaluatorGroup, 0, &evaluatorComm);
+    MPI_Group_free(&worldGroup);
+    MPI_Group_free(&evaluatorGroup);
+
+    // (sequence, length) of every month of every evaluator
+    int members;
+    MPI_Comm_size(evaluatorComm, &members);
+    vector<long long> mine;
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        mine.push_back(sequences[i]);
+        mine.push_back(lengths[i]);
+    }
+    int count = mine.size();
+    vector<int> counts(members), displacements(members, 0);
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, evaluatorComm);
+    for (int i = 1; i < members; ++i) {
+        displacements[i] = displacements[i - 1] + counts[i - 1];
+    }
+    vector<long long> all(displacements[members - 1] + counts[members - 1]);
+    MPI_Allgatherv(mine.data(), count, MPI_LONG_LONG, all.data(), counts.data(), displacements.data(), MPI_LONG_LONG, evaluatorComm);
+
+    // The detector numbers months 0, 1, 2, ..., so a month's offset is the length of all months before it
+    vector<long long> offsets(all.size() / 2 + 1, 0);
+    for (size_t i = 0; i < all.size(); i += 2) {
+        offsets[all[i] + 1] = all[i + 1];
+    }
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+
+    // This rank's non-empty months as ranges of the file, in increasing order since months arrive in order
+    vector<int> blockLengths;
+    vector<MPI_Aint> blockOffsets;
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        if (lengths[i] > 0) {
+            blockLengths.push_back(lengths[i]);
+            blockOffsets.push_back(offsets[sequences[i]]);
+        }
+    }
+
+    MPI_File file;
+    if (MPI_File_open(evaluatorComm, outputFile.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        cerr << "Could not open " << outputFile << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_File_set_size(file, offsets.back());
+
+    MPI_Datatype fileType = MPI_CHAR;
+    if (!blockLengths.empty()) {
+        MPI_Type_create_hindexed(blockLengths.size(), blockLengths.data(), blockOffsets.data(), MPI_CHAR, &fileType);
+        MPI_Type_commit(&fileType);
+    }
+    MPI_File_set_view(file, 0, MPI_CHAR, fileType, "native", MPI_INFO_NULL);
+    MPI_File_write_all(file, report.data(), report.size(), MPI_CHAR, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    if (fileType != MPI_CHAR) {
+        MPI_Type_free(&fileType);
+    }
+    MPI_Comm_free(&evaluatorComm);
 }
 
 
@@ -302,45 +1025,352 @@ void TemperatureAnalysisMPI::evaluateMonthlyTemperatures(void)
 void TemperatureAnalysisMPI::fileWriter(const string &outputFile)
 {
     ofstream outFile(outputFile);
-    
-    while (true) {
-        // Receive the size of the current batch of data
-        int batchSize;
-        MPI_Recv(&batchSize, 1, MPI_INT, EVALUATETEMPERATURES, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        
-        if (batchSize == -1) {
-            // End signal received, exit the loop
+
+    // Findings arrive from every evaluator rank; write them in month order
+    BatchReceiver fromEvaluators = linkFrom(evaluatorRanks());
+    BatchReorder monthOrder;
+    const char *buffer;
+    int bufferSize;
+
+    vector<TemperatureData> dataBatch;
+
+    auto writeBatch = [&](const char *batch, int size) {
+        BatchHeader header;
+        unpackRecordBatch(batch, size, header, dataBatch);
+        size_t batchSize = dataBatch.size();
+
+        // Format and write each entry; the stream's buffer collects lines until it is full or closed
+        for (size_t i = 0; i < batchSize; ++i) {
+            formatFinding(outFile, dataBatch[i]);
+        }
+    };
+
+    while (fromEvaluators.receive(buffer, bufferSize)) {
+        monthOrder.push(buffer, bufferSize, writeBatch);
+    }
+
+    // Close the output file
+    outFile.close();
+    printf("write file terminate (idle %.6f s receiving)\n", fromEvaluators.idleSeconds());
+}
+
+// Data-parallel mode: decodes the whole lines at the front of [data, data + length) into batch and keeps
+// the unfinished line at the end in pending, to be completed by the next block
+static void decodeWholeLines(ThreadTeam &team, const char *data, size_t length, string &pending, LogBatch &batch) {
+    const char *lastBreak = (const char *)memrchr(data, '\n', length);
+    if (lastBreak == NULL) {
+        pending.append(data, length);
+        return;
+    }
+
+    size_t whole = lastBreak + 1 - data;
+    if (pending.empty()) {
+        parseLogBlockWithTeam(team, data, whole, batch);
+    } else {
+        pending.append(data, whole);
+        parseLogBlockWithTeam(team, pending.data(), pending.size(), batch);
+        pending.clear();
+    }
+    pending.assign(lastBreak + 1, length - whole);
+}
+
+// Data-parallel mode: reads the lines that start inside this rank's 1/size share of the file
+void TemperatureAnalysisMPI::readOwnRange(const string &filename, ThreadTeam &team, LogBatch &batch) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, filename.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        cerr << "Could not open " << filename << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Offset fileSize;
+    MPI_File_get_size(file, &fileSize);
+
+    // This rank owns the lines that start in [begin, end)
+    MPI_Offset begin = fileSize * rank / size;
+    MPI_Offset end = fileSize * (rank + 1) / size;
+
+    // Start one byte early to tell whether a line starts exactly at begin; until the first
+    // line break, bytes belong to a line owned by the previous rank
+    MPI_Offset position = (begin > 0) ? begin - 1 : 0;
+    bool skipping = begin > 0;
+
+    // Every rank has to make the same number of collective calls
+    long long blocks = (end - position + READ_BLOCK - 1) / READ_BLOCK;
+    long long maxBlocks;
+    MPI_Allreduce(&blocks, &maxBlocks, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+
+    vector<char> buffer;
+    string pending;
+    for (long long i = 0; i < maxBlocks; ++i) {
+        int count = (int)min<MPI_Offset>(READ_BLOCK, max<MPI_Offset>(end - position, 0));
+        buffer.resize(count);
+        MPI_File_read_at_all(file, position, buffer.data(), count, MPI_CHAR, MPI_STATUS_IGNORE);
+        position += count;
+
+        const char *data = buffer.data();
+        size_t length = count;
+        if (skipping) {
+            const char *lineBreak = (const char *)memchr(data, '\n', length);
+            if (lineBreak == NULL) {
+                continue;
+            }
+            skipping = false;
+            length -= lineBreak + 1 - data;
+            data = lineBreak + 1;
+        }
+        decodeWholeLines(team, data, length, pending, batch);
+    }
+
+    // The last line owned by this rank may run past end: finish it with independent reads
+    char tail[4096];
+    while (!pending.empty() && position < fileSize) {
+        int count = (int)min<MPI_Offset>(sizeof(tail), fileSize - position);
+        MPI_File_read_at(file, position, tail, count, MPI_CHAR, MPI_STATUS_IGNORE);
+        position += count;
+
+        const char *lineBreak = (const char *)memchr(tail, '\n', count);
+        pending.append(tail, (lineBreak == NULL) ? count : lineBreak + 1 - tail);
+        if (lineBreak != NULL) {
             break;
         }
+    }
+    if (!pending.empty()) {
+        parseLogBlock(pending.data(), pending.size(), batch);
+    }
+
+    MPI_File_close(&file);
+}
+
+// Data-parallel mode: decodes this rank's 1/size share of the blocks of a columnar cache. The blocks
+// are mapped straight from the file, so nothing is read that this rank does not decode.
+void TemperatureAnalysisMPI::readOwnBlocks(const string &filename, ThreadTeam &team, LogBatch &batch) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    ColumnarLog cache;
+    if (!cache.open(filename)) {
+        cerr << "Could not open columnar cache " << filename << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    size_t first = cache.blockCount() * rank / size;
+    size_t last = cache.blockCount() * (rank + 1) / size;
+    if (first < last) {
+        cache.adviseSequential(first, last);
+        vector<ColumnarBlock> blocks(&cache.block(first), &cache.block(last - 1) + 1);
+        decodeBlocksWithTeam(team, blocks, cache.data() + blocks[0].offset, batch);
+    }
+}
+
+// Data-parallel mode: the anomaly detector's rule for one record. The first record of the file is
+// kept, the first record of every later month only seeds previousTemp, and a jump of more than the
+// anomaly threshold from the last accepted temperature is dropped. Like anomalyDetector, a
+// previousTemp of exactly -1 counts as unset, so the record after a -1 reading is compared with itself.
+bool TemperatureAnalysisMPI::acceptReading(FilterCarry &state, int month, double temperature) {
+    if (state.previousTemp == -1) {
+        state.previousTemp = temperature;
+    }
+    if (state.month == -1 || month != state.month) {
+        bool first = (state.month == -1);
+        state.month = month;
+        state.previousTemp = temperature;
+        return first;
+    }
+    if (isAnomaly(temperature, state.previousTemp)) {
+        return false;
+    }
+    state.previousTemp = temperature;
+    return true;
+}
+
+// Data-parallel mode: the evaluator's rule for one accepted record. Reports a reading outside
+// mean +/- stddev of its month unless the month's last report was on the same day or hour.
+bool TemperatureAnalysisMPI::reportReading(ReportCarry &state, int month, int day, int hour, double temperature,
+                                           const vector<RunningStats> &monthStats) {
+    if (month != state.month) {
+        state.month = month;
+        state.hour = -1;
+        state.day = -1;
+    }
+
+    int calendarMonth = month % 12 + 1;
+    double mean = monthStats[month].mean;
+    double stddev = sqrt(monthStats[month].variance());
+
+    bool issue = false;
+    if (isCoolingMonth(calendarMonth)) {
+        issue = temperature > mean + stddev;
+    } else if (isHeatingMonth(calendarMonth)) {
+        issue = temperature < mean - stddev;
+    }
+
+    if (issue && hour != state.hour && day != state.day) {
+        state.hour = hour;
+        state.day = day;
+        return true;
+    }
+    return false;
+}
+
+// Combines per-month statistics of consecutive ranks: inout = in (lower ranks) followed by inout
+static void mergeMonthStats(void *in, void *inout, int *len, MPI_Datatype *) {
+    RunningStats *earlier = (RunningStats *)in;
+    RunningStats *later = (RunningStats *)inout;
+    for (int i = 0; i < *len; ++i) {
+        RunningStats merged = earlier[i];
+        merged.merge(later[i]);
+        later[i] = merged;
+    }
+}
+
+// Data-parallel mode. Instead of one rank per pipeline stage, every rank:
+//  1. reads the lines starting in its share of the file with collective MPI-IO and decodes them,
+//  2. applies the anomaly detector's rules to its records,
+//  3. summarizes the accepted readings per month; MPI_Allreduce merges the summaries of all ranks,
+//  4. reports the readings of its share that fall outside mean +/- stddev of their month,
+//  5. writes its report lines into the output file after those of the ranks before it.
+// Steps 2 and 4 are sequential rules whose state crosses range boundaries. Each rank first runs them
+// from a guessed start state; when the true state arrives from rank - 1, only the records up to
+// the point where both runs agree are redone. Usually that is a handful of records, so the hand-off
+// costs almost nothing compared to reading and parsing.
+void TemperatureAnalysisMPI::dataParallel(const string &filename, const string &outputFile) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // 1. Read and decode this rank's lines, with all of the rank's threads
+    ThreadTeam team(threadCount);
+    LogBatch batch;
+    if (columnarInput) {
+        readOwnBlocks(filename, team, batch);
+    } else {
+        readOwnRange(filename, team, batch);
+    }
+    size_t count = batch.size();
+
+    vector<int> months(count), days(count), hours(count);
+    LogRecord record;
+    for (size_t i = 0; i < count; ++i) {
+        batch.get(i, record);
+        months[i] = record.year * 12 + record.month - 1;
+        days[i] = record.day;
+        hours[i] = record.hour;
+    }
+
+    // 2. Anomaly filter, guessing that this range starts with a new month
+    const FilterCarry filterGuess = {(rank == 0) ? -1 : -2, 0.0};
+    vector<char> accepted(count);
+    FilterCarry filterState = filterGuess;
+    for (size_t i = 0; i < count; ++i) {
+        accepted[i] = acceptReading(filterState, months[i], batch.temperatures[i]);
+    }
+
+    if (rank > 0) {
+        FilterCarry incoming;
+        MPI_Recv(&incoming, sizeof(incoming), MPI_BYTE, rank - 1, FILTER_CARRY, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        // Redo records until the true and the guessed run reach the same state
+        FilterCarry truth = incoming, guess = filterGuess;
+        for (size_t i = 0; i < count && !(truth == guess); ++i) {
+            accepted[i] = acceptReading(truth, months[i], batch.temperatures[i]);
+            acceptReading(guess, months[i], batch.temperatures[i]);
+        }
+        if (!(truth == guess)) {
+            filterState = truth;
+        }
+    }
+    if (rank < size - 1) {
+        MPI_Send(&filterState, sizeof(filterState), MPI_BYTE, rank + 1, FILTER_CARRY, MPI_COMM_WORLD);
+    }
+
+    // 3. Per-month statistics of the accepted readings, merged across ranks in rank order
+    vector<RunningStats> monthStats(MONTH_SLOTS);
+    for (size_t i = 0; i < count; ++i) {
+        if (accepted[i]) {
+            monthStats[months[i]].add(batch.temperatures[i]);
+        }
+    }
 
-        // Create a vector to hold the received batch of TemperatureData
-        vector<TemperatureData> dataBatch(batchSize);
-        
-        // Receive the batch of data
-        MPI_Recv(dataBatch.data(), batchSize * sizeof(TemperatureData), MPI_BYTE, EVALUATETEMPERATURES, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        
-        // Process each entry in the received data batch
-        for (const auto& entry : dataBatch) {
-            // Format and write the entry to the output file
-            if (isHeatingMonth(entry.month)) {
-                outFile << "Heating issue detected: "
-                        << entry.month << "/" << entry.day << "/" << entry.year
-                        << " At Hour: " << entry.hour << " | Temp: " << entry.temperature << endl;
-            } 
-            else if (isCoolingMonth(entry.month)) {
-                outFile << "Cooling issue detected: "
-                        << entry.month << "/" << entry.day << "/" << entry.year
-                        << " At Hour: " << entry.hour << " | Temp: " << entry.temperature << endl;
+    MPI_Datatype statsType;
+    MPI_Type_contiguous(sizeof(RunningStats), MPI_BYTE, &statsType);
+    MPI_Type_commit(&statsType);
+    MPI_Op mergeOp;
+    MPI_Op_create(mergeMonthStats, 0, &mergeOp); // Not commutative: keep rank order for reproducible results
+    MPI_Allreduce(MPI_IN_PLACE, monthStats.data(), MONTH_SLOTS, statsType, mergeOp, MPI_COMM_WORLD);
+    MPI_Op_free(&mergeOp);
+    MPI_Type_free(&statsType);
+
+    if (rank == 0) {
+        for (int month = 0; month < MONTH_SLOTS; ++month) {
+            if (monthStats[month].count > 0) {
+                printf("Month: %d\t Mean: %f\t STDV: %f\n", month % 12 + 1, monthStats[month].mean, sqrt(monthStats[month].variance()));
             }
         }
-        
-        // Flush the output to ensure it's written immediately
-        outFile.flush();
     }
 
-    // Close the output file
-    outFile.close();
-    printf("write file terminate\n");
+    // 4. Report readings outside mean +/- stddev, again guessing that the range starts a new month
+    const ReportCarry reportGuess = {(rank == 0) ? -1 : -2, -1, -1};
+    vector<char> reported(count);
+    ReportCarry reportState = reportGuess;
+    for (size_t i = 0; i < count; ++i) {
+        if (accepted[i]) {
+            reported[i] = reportReading(reportState, months[i], days[i], hours[i], batch.temperatures[i], monthStats);
+        }
+    }
+
+    if (rank > 0) {
+        ReportCarry incoming;
+        MPI_Recv(&incoming, sizeof(incoming), MPI_BYTE, rank - 1, REPORT_CARRY, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        ReportCarry truth = incoming, guess = reportGuess;
+        for (size_t i = 0; i < count && !(truth == guess); ++i) {
+            if (accepted[i]) {
+                reported[i] = reportReading(truth, months[i], days[i], hours[i], batch.temperatures[i], monthStats);
+                reportReading(guess, months[i], days[i], hours[i], batch.temperatures[i], monthStats);
+            }
+        }
+        if (!(truth == guess)) {
+            reportState = truth;
+        }
+    }
+    if (rank < size - 1) {
+        MPI_Send(&reportState, sizeof(reportState), MPI_BYTE, rank + 1, REPORT_CARRY, MPI_COMM_WORLD);
+    }
+
+    // 5. Write this rank's share of the report after the shares of the ranks before it
+    ostringstream report;
+    for (size_t i = 0; i < count; ++i) {
+        if (reported[i]) {
+            batch.get(i, record);
+            report << (isHeatingMonth(record.month) ? "Heating" : "Cooling") << " issue detected: "
+                   << record.month << "/" << record.day << "/" << record.year
+                   << " At Hour: " << record.hour << " | Temp: " << record.temperature << endl;
+        }
+    }
+
+    // MPI_Exscan of the shares' lengths gives each rank its offset, and all ranks write at once
+    string text = report.str();
+    long long length = text.size(), offset = 0, total = 0;
+    MPI_Exscan(&length, &offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        offset = 0; // MPI_Exscan leaves rank 0's result undefined
+    }
+    MPI_Allreduce(&length, &total, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, outputFile.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        cerr << "Could not open " << outputFile << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_File_set_size(file, total);
+    MPI_File_write_at_all(file, offset, text.data(), length, MPI_CHAR, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    printf("rank %d: %zu records, %zu accepted\n", rank, count, (size_t)count_if(accepted.begin(), accepted.end(), [](char a) { return a != 0; }));
 }
 
 // Helper function to determine if temperature is an anomaly
@@ -349,35 +1379,70 @@ bool TemperatureAnalysisMPI::isAnomaly(double current, double previous)
     return fabs(current - previous) > 2.0; // Custom threshold for anomalies
 }
 
-// Function to calculate the mean of the temperatures
-double TemperatureAnalysisMPI::calculateMean(vector<TemperatureData> &temperatures) {
+// Function to calculate the mean of the temperatures; each thread of the team sums a slice
+double TemperatureAnalysisMPI::calculateMean(vector<TemperatureData> &temperatures, ThreadTeam &team) {
     if (temperatures.empty()) {
         return 0.0; // Handle empty vector case
     }
 
+    int parts = team.size();
+    vector<double> sums(parts, 0.0);
+    team.run(parts, [&](int part) {
+        size_t begin = temperatures.size() * part / parts;
+        size_t end = temperatures.size() * (part + 1) / parts;
+        for (size_t i = begin; i < end; ++i) {
+            sums[part] += temperatures[i].temperature;
+        }
+    });
+
     double sum = 0.0;
-    for (const auto &data : temperatures) {
-        sum += data.temperature;
+    for (double partSum : sums) {
+        sum += partSum;
     }
 
     return sum / temperatures.size();
 }
 
-// Function to calculate the standard deviation of the temperatures
-double TemperatureAnalysisMPI::calculateStdDev(vector<TemperatureData> &temperatures, double mean) {
+// Function to calculate the standard deviation of the temperatures; each thread of the team sums a slice
+double TemperatureAnalysisMPI::calculateStdDev(vector<TemperatureData> &temperatures, double mean, ThreadTeam &team) {
     if (temperatures.empty()) {
         return 0.0; // Handle empty vector case
     }
 
+    int parts = team.size();
+    vector<double> sums(parts, 0.0);
+    team.run(parts, [&](int part) {
+        size_t begin = temperatures.size() * part / parts;
+        size_t end = temperatures.size() * (part + 1) / parts;
+        for (size_t i = begin; i < end; ++i) {
+            double diff = temperatures[i].temperature - mean;
+            sums[part] += diff * diff;
+        }
+    });
+
     double sumSquaredDiffs = 0.0;
-    for (const auto &data : temperatures) {
-        double diff = data.temperature - mean;
-        sumSquaredDiffs += diff * diff;
+    for (double partSum : sums) {
+        sumSquaredDiffs += partSum;
     }
 
     return sqrt(sumSquaredDiffs / temperatures.size());
 }
 
+// Appends the report line of a finding
+void TemperatureAnalysisMPI::formatFinding(ostream &out, const TemperatureData &entry)
+{
+    if (isHeatingMonth(entry.month)) {
+        out << "Heating issue detected: "
+            << entry.month << "/" << entry.day << "/" << entry.year
+            << " At Hour: " << entry.hour << " | Temp: " << entry.temperature << '\n';
+    }
+    else if (isCoolingMonth(entry.month)) {
+        out << "Cooling issue detected: "
+            << entry.month << "/" << entry.day << "/" << entry.year
+            << " At Hour: " << entry.hour << " | Temp: " << entry.temperature << '\n';
+    }
+}
+
 // Check if month is designated for heating
 bool TemperatureAnalysisMPI::isHeatingMonth(int month)
 {
@@ -390,6 +1455,48 @@ bool TemperatureAnalysisMPI::isCoolingMonth(int month)
     return find(coolingMonths.begin(), coolingMonths.end(), month) != coolingMonths.end();
 }
 
+// Set the bytes of input per batch from the reader to the parser
+void TemperatureAnalysisMPI::setBatchBytes(int bytes)
+{
+    batchBytes = min(max(bytes, 1), MAX_BATCH_BYTES);
+}
+
+// Let the reader tune the batch size at run time
+void TemperatureAnalysisMPI::setAdaptiveBatching(bool adaptive)
+{
+    adaptiveBatching = adaptive;
+}
+
+// Set the number of evaluator ranks (EVALUATETEMPERATURES plus count - 1 ranks from EXTRA_RANKS)
+void TemperatureAnalysisMPI::setEvaluatorCount(int count)
+{
+    evaluatorCount = max(count, 1);
+}
+
+// Let the evaluators write the report together instead of sending findings to the writer rank
+void TemperatureAnalysisMPI::setCollectiveOutput(bool collective)
+{
+    collectiveOutput = collective;
+}
+
+// Read a columnar cache instead of a text log
+void TemperatureAnalysisMPI::setColumnarInput(bool columnar)
+{
+    columnarInput = columnar;
+}
+
+// Let the pipeline reader skip months that are neither heating nor cooling months
+void TemperatureAnalysisMPI::setMonthIndex(bool enabled)
+{
+    useMonthIndex = enabled;
+}
+
+// Set the threads each rank uses for its stage
+void TemperatureAnalysisMPI::setThreads(int threads)
+{
+    threadCount = max(threads, 1);
+}
+
 // Set the months designated for heating
 void TemperatureAnalysisMPI::setHeatingMonths(const vector<int> &months)
 {
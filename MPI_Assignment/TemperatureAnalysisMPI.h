@@ -12,7 +12,17 @@
 #include <cstring>
 #include <queue>
 #include <unordered_map>
+#include <future>
+#include <map>
+#include <memory>
 #include <set>
+#include "ColumnarLog.h"
+#include "CompressedReader.h"
+#include "LogBatch.h"
+#include "LogIndex.h"
+#include "RunningStats.h"
+#include "SharedRing.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
@@ -27,41 +37,352 @@ struct TemperatureData {
 // MPI Pipeline roles
 enum Role { FILEREADER = 0, PARSER = 1, ANOMALYDETECTOR = 2, EVALUATETEMPERATURES = 3, FILEWRITER = 4 };
 
-// Batch size for data transfer
-constexpr int BATCH_SIZE = 100;
+// Ranks from this one up are additional evaluators (see setEvaluatorCount) followed by additional parsers
+constexpr int EXTRA_RANKS = 5;
+
+// Leads every batch on a path that fans out over several ranks and back in. The reader numbers its
+// batches and the parsers keep the number, so the detector can put them back in file order; likewise
+// the detector numbers months and the evaluators keep the number for the writer.
+struct BatchHeader {
+    long long sequence;
+};
+
+// Hybrid mode: threads of one rank working on a stage's batch together. The calling thread takes
+// part too and is the only one that makes MPI calls (MPI_THREAD_FUNNELED).
+class ThreadTeam {
+public:
+    explicit ThreadTeam(int threads) {
+        if (threads > 1) {
+            pool.reset(new ThreadPool(threads - 1));
+        }
+    }
+
+    int size() const { return pool ? pool->size() + 1 : 1; }
+
+    // Runs body(part) for every part in [0, parts) and returns once all of them are done
+    template <typename Body>
+    void run(int parts, Body body) {
+        if (!pool) {
+            for (int part = 0; part < parts; ++part) {
+                body(part);
+            }
+            return;
+        }
+
+        vector<future<void>> done;
+        for (int part = 1; part < parts; ++part) {
+            done.push_back(pool->submit(bind(body, part)));
+        }
+        body(0);
+        for (future<void> &part : done) {
+            part.get();
+        }
+    }
+
+private:
+    unique_ptr<ThreadPool> pool;
+};
+
+// Smallest share of a text block worth handing to another thread
+constexpr size_t MIN_THREAD_BYTES = 64 * 1024;
+
+// Compact wire form of a TemperatureData record: a packed timestamp (see packTimestamp) and the
+// temperature in tenths of a degree, the precision of the log (see wireTenths), with -0.0 sent as
+// TENTHS_NEGATIVE_ZERO. 6 bytes of data instead of the 32 byte struct.
+struct WireRecord {
+    uint32_t timestamp;
+    int16_t tenths;
+};
+
+// Committed MPI datatype describing WireRecord field by field, so MPI can convert it between nodes
+MPI_Datatype wireRecordType();
+// Frees the datatype wireRecordType() committed, if any; call before MPI_Finalize
+void freeWireRecordType();
+
+// Tenths of a degree of a temperature going on the wire. Aborts the run on a reading that tenths
+// cannot hold exactly, instead of sending a rounded or wrapped value.
+int16_t wireTenths(double temperature);
+
+WireRecord toWireRecord(const TemperatureData &data);
+TemperatureData fromWireRecord(const WireRecord &record);
+
+// Link batches are MPI_PACKED buffers: the BatchHeader as MPI_LONG_LONG, then the payload. These unpack
+// batches of records (see sendRecordBatch); the reader's text batches use MPI_CHAR for the payload instead,
+// and its batches of columnar cache blocks an MPI_INT block count, the ColumnarBlock entries and the
+// blocks' bytes as MPI_BYTE.
+void unpackRecordBatch(const char *buffer, int size, BatchHeader &header, vector<TemperatureData> &records);
+void unpackBatchHeader(const char *buffer, int size, BatchHeader &header, int &position);
+
+// Puts numbered batches arriving from several ranks back in sequence order
+class BatchReorder {
+public:
+    BatchReorder() : nextSequence(0) {}
+
+    // Takes a received batch and runs process on it and on every held batch that can follow it,
+    // in sequence order. A batch that arrives before its predecessors is copied and held back.
+    template <typename Process>
+    void push(const char *batch, int size, Process process) {
+        BatchHeader header;
+        int position = 0;
+        unpackBatchHeader(batch, size, header, position);
+        if (header.sequence != nextSequence) {
+            early[header.sequence].assign(batch, batch + size);
+            return;
+        }
+
+        process(batch, size);
+        nextSequence++;
+
+        // Catch up on batches that were waiting for this one
+        for (auto next = early.find(nextSequence); next != early.end(); next = early.find(nextSequence)) {
+            process(next->second.data(), (int)next->second.size());
+            early.erase(next);
+            nextSequence++;
+        }
+    }
+
+private:
+    map<long long, vector<char>> early; // Batches that arrived before their predecessors, by sequence number
+    long long nextSequence;
+};
+
+// Default bytes of input lines per batch sent from the reader to the parser
+constexpr int DEFAULT_BATCH_BYTES = 64 * 1024;
+
+// Range the adaptive mode keeps batches in, and how many batches it measures before resizing
+constexpr int MIN_BATCH_BYTES = 4 * 1024;
+constexpr int MAX_BATCH_BYTES = 16 * 1024 * 1024;
+constexpr int ADAPT_WINDOW = 16;
+
+// Chooses the size of the reader's batches. With a fixed size it just returns it; in adaptive mode it
+// measures the bytes per second the reader sustains over each window of ADAPT_WINDOW batches (reading,
+// sending and waiting for the parser to take batches) and keeps doubling or halving the batch size in
+// the direction that made that rate go up.
+class BatchSizer {
+public:
+    BatchSizer(int initialBytes, bool adaptive);
+    int bytes() const { return current; }
+    // Records a batch of count bytes that was just sent
+    void record(int count);
+
+private:
+    int current;
+    bool adaptive;
+    int direction;       // 1 to grow, -1 to shrink on the next change
+    int windowBatches;
+    long long windowBytes;
+    double windowStart;
+    double previousRate; // Bytes per second of the previous window, 0 before the first
+};
+
+// Batches each pipeline link keeps in flight, so a stage can work on one while others are on the wire
+constexpr int LINK_BUFFERS = 2;
+
+// Tags of a pipeline link: each batch is one MPI_PACKED LINK_DATA message whose length the receiver
+// learns with MPI_Probe, and an empty LINK_END message ends the stream. On a shared-memory link, a
+// batch too large for the ring travels as a LINK_REDIRECT message instead.
+enum LinkTag { LINK_DATA = 10, LINK_END = 11, LINK_REDIRECT = 12 };
+
+// Bytes of messages in the shared-memory ring of each link between two ranks of one node
+constexpr size_t SHARED_RING_BYTES = 4 * 1024 * 1024;
+
+// A rank waiting on a link spins for BACKOFF_SPINS polls, then yields for BACKOFF_YIELDS polls, then
+// sleeps BACKOFF_SLEEP_NS between polls, so idle ranks oversubscribed on one node leave the cores free
+constexpr int BACKOFF_SPINS = 16;
+constexpr int BACKOFF_YIELDS = 128;
+constexpr long BACKOFF_SLEEP_NS = 20 * 1000;
+
+// Sending end of a pipeline link. A batch is built in the space reserve() returns and handed over
+// with publish(). Between ranks on different nodes that space is one of LINK_BUFFERS buffers whose
+// non-blocking send publish() starts; reserve() only waits when all of them are still in flight.
+// Between ranks of one node it is the link's SharedRing, and publishing just moves the ring's tail.
+class BatchSender {
+public:
+    explicit BatchSender(int destination, SharedRing *ring = NULL);
+    // Space for a batch of count bytes
+    char *reserve(int count);
+    // Sends the first count bytes of the reserved space as one batch
+    void publish(int count);
+    // Sends count bytes as one batch
+    void send(const void *data, int count);
+    // Sends the end of stream signal and waits for every batch to be delivered
+    void finish();
+    // Seconds spent waiting for a buffer or ring space to become free
+    double idleSeconds() const { return idle; }
+
+private:
+    struct Slot {
+        vector<char> payload;
+        MPI_Request request;
+    };
+
+    void publishMarker(SharedRing::Kind kind);
+
+    Slot slots[LINK_BUFFERS];
+    int next;
+    int destination;
+    SharedRing *ring; // NULL unless the destination shares this rank's node
+    bool inRing;      // The reserved space is in the ring
+    double idle;
+};
+
+// Receiving end of a pipeline link. When the next batch has already arrived, its receive is posted
+// before the current one is handed to the stage, so the transfer overlaps with the stage's work.
+// With several senders it takes batches in arrival order. Senders on this rank's node hand batches
+// over through their SharedRing, which the stage then reads in place.
+class BatchReceiver {
+public:
+    // sources: ranks sending on this link; rings: for each of them its SharedRing, or NULL
+    BatchReceiver(const vector<int> &sources, const vector<SharedRing *> &rings);
+    // Waits for the next batch and points batch at its count bytes, which stay valid until the next
+    // call; false once every sender has finished
+    bool receive(const char *&batch, int &count);
+    // Seconds spent waiting for a batch to arrive
+    double idleSeconds() const { return idle; }
+
+private:
+    struct Slot {
+        vector<char> payload;
+        MPI_Request request;
+    };
+
+    bool post(Slot &slot, MPI_Status &status);
+    bool receiveOverMpi(const char *&batch, int &count);
+    void receiveRedirected(int sender, const char *&batch, int &count);
+
+    Slot slots[LINK_BUFFERS];
+    int current;
+    int source;  // MPI_ANY_SOURCE unless a single sender uses MPI
+    int senders; // Senders using MPI that have not finished yet
+    vector<SharedRing *> rings;  // Rings of the senders on this node that have not finished yet
+    vector<int> ringSenders;     // Rank at the other end of each ring
+    SharedRing *held;            // Ring holding the batch handed out last
+    double idle;
+};
+
+// Packs a batch of records behind its header straight into the link's send space
+void sendRecordBatch(BatchSender &link, const BatchHeader &header, const vector<WireRecord> &records);
+
+// Pipeline reader: bytes of decompressed text per block of a .gz or .zst log
+constexpr int DECOMPRESS_BLOCK = 1024 * 1024;
+
+// Data-parallel mode: bytes each rank reads per collective MPI-IO call
+constexpr int READ_BLOCK = 64 * 1024 * 1024;
+
+// Data-parallel mode: one statistics slot per (two digit year, month)
+constexpr int MONTH_SLOTS = 100 * 12;
+
+// Data-parallel mode: tags of the hand-offs between neighbouring ranks
+enum CarryTag { FILTER_CARRY = 1, REPORT_CARRY = 2 };
+
+// Anomaly detector state after the last record of a rank's range; month is a slot (year * 12 + month - 1)
+struct FilterCarry {
+    int month;           // -1 before the first record of the file
+    double previousTemp; // Last accepted temperature of that month
+
+    bool operator==(const FilterCarry &other) const { return month == other.month && previousTemp == other.previousTemp; }
+};
+
+// Report state after the last record of a rank's range: where the month's last issue was reported
+struct ReportCarry {
+    int month; // Month slot, -1 before the first record
+    int hour;
+    int day;
+
+    bool operator==(const ReportCarry &other) const { return month == other.month && hour == other.hour && day == other.day; }
+};
 
 
 
 class TemperatureAnalysisMPI {
 public:
-    // Parse a line of input
-    TemperatureData parseLine(const string &line);
     // File reader stage
     void fileReader(const string &filename);
     // Parser stage
     void parser();
+    // Ranks running the parser stage
+    vector<int> parserRanks();
+    // Ranks running the evaluation stage
+    vector<int> evaluatorRanks();
     // Anomaly detection stage
     void anomalyDetector();
-    // evaluate stage
-    void evaluateMonthlyTemperatures();
+    // evaluate stage; with collective output it writes its findings to outputFile
+    void evaluateMonthlyTemperatures(const string &outputFile);
     // anomaly detector helper
     bool isAnomaly(double current, double previous);
     // File writer stage
     void fileWriter(const string &outputFile);
 
+    // Data-parallel mode: every rank reads, filters and reports its own share of the file
+    void dataParallel(const string &filename, const string &outputFile);
+
+    // Bytes of input per batch from the reader to the parser
+    void setBatchBytes(int bytes);
+    // Let the reader tune the batch size while it runs, starting from the configured size
+    void setAdaptiveBatching(bool adaptive);
+    // Number of evaluator ranks; months are spread over them by (year, month)
+    void setEvaluatorCount(int count);
+    // Threads each rank uses for its stage (hybrid mode)
+    void setThreads(int threads);
+    // Evaluators write the report with collective MPI-IO (default) instead of through the writer rank
+    void setCollectiveOutput(bool collective);
+    // The input is a columnar cache (see ColumnarLog.h) rather than a text log; must be set on every rank
+    void setColumnarInput(bool columnar);
+    // The pipeline reader reads only the heating and cooling months of a text log, found with its sidecar
+    // LogIndex (built by the first run that needs it)
+    void setMonthIndex(bool enabled);
+
+    // Gives every pipeline link whose two ranks share a node a SharedRing; collective over MPI_COMM_WORLD
+    void setupSharedLinks();
+    // Frees the rings once every stage has finished; collective over MPI_COMM_WORLD
+    void releaseSharedLinks();
+
     // Helper function declarations
     bool isHeatingMonth(int month);
     bool isCoolingMonth(int month);
+    void formatFinding(ostream &out, const TemperatureData &entry);
     void setHeatingMonths(const vector<int>& months);
     void setCoolingMonths(const vector<int>& months);
     
     
-    double calculateMean(vector<TemperatureData> &temperatures);
-    double calculateStdDev(vector<TemperatureData> &temperatures, double mean);
+    double calculateMean(vector<TemperatureData> &temperatures, ThreadTeam &team);
+    double calculateStdDev(vector<TemperatureData> &temperatures, double mean, ThreadTeam &team);
 
 private:
     vector<int> heatingMonths;
     vector<int> coolingMonths;
+    int batchBytes = DEFAULT_BATCH_BYTES;
+    bool adaptiveBatching = false;
+    int evaluatorCount = 1;
+    int threadCount = 1;
+    bool collectiveOutput = true;
+    bool columnarInput = false;
+    bool useMonthIndex = false;
+
+    // A pipeline link between two ranks of one node, whose ring lives in the receiver's share of linkWindow
+    struct SharedLink {
+        int sender;
+        int receiver;
+        SharedRing ring;
+    };
+    vector<SharedLink> sharedLinks;
+    MPI_Comm nodeComm = MPI_COMM_NULL;
+    MPI_Win linkWindow = MPI_WIN_NULL;
+
+    // Link helpers: the sending or receiving end of a link of this rank, through a ring where there is one
+    vector<pair<int, int>> pipelineLinks();
+    SharedRing *sharedRing(int sender, int receiver);
+    BatchSender linkTo(int receiver);
+    BatchReceiver linkFrom(const vector<int> &senders);
+
+    void writeReportCollectively(const string &outputFile, const string &report,
+                                 const vector<long long> &sequences, const vector<long long> &lengths);
+
+    // Data-parallel helpers
+    void readOwnRange(const string &filename, ThreadTeam &team, LogBatch &batch);
+    void readOwnBlocks(const string &filename, ThreadTeam &team, LogBatch &batch);
+    bool acceptReading(FilterCarry &state, int month, double temperature);
+    bool reportReading(ReportCarry &state, int month, int day, int hour, double temperature, const vector<RunningStats> &monthStats);
 };
 
 
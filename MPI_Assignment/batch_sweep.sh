@@ -0,0 +1,14 @@
+#!/bin/bash
+# Throughput of the MPI pipeline against the reader's batch size.
+# Run from the directory holding the compiled main and bigw12a.log (see run.sh), e.g. inside the job
+# after the compile step:  NP=$SLURM_NTASKS ./batch_sweep.sh
+
+NP=${NP:-5}
+
+for bytes in 1024 4096 16384 65536 262144 1048576 4194304 16777216; do
+    printf "%9s bytes: " $bytes
+    mpirun -np $NP ./main --batch-bytes $bytes | grep "read terminate"
+done
+
+printf "%15s: " adaptive
+mpirun -np $NP ./main --adaptive-batch | grep "read terminate"
@@ -0,0 +1,58 @@
+#!/bin/bash
+# Checks that --data-parallel writes the same report as the 5 rank pipeline, on a log that crosses
+# -1 degrees often (the anomaly detector's "unset" value) and has spikes for the filter to drop.
+# usage: data_parallel_test.sh <program> <mpiexec> <numproc flag> [mpiexec flags...]
+PROGRAM=$(realpath "$1")
+MPIEXEC=$2
+NP_FLAG=$3
+shift 3
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+# Ten winter days of readings every 30 seconds, wandering around zero in steps of tenths
+awk 'BEGIN {
+    srand(5); t = 0.0
+    for (m = 1; m <= 3; m++) for (d = 1; d <= 10; d++) for (s = 0; s < 86400; s += 30) {
+        t += (int(rand() * 7) - 3) / 10
+        if (t > 6) t -= 0.5
+        if (t < -6) t += 0.5
+        r = (rand() < 0.01) ? t + 4 : t
+        printf "%02d/%02d/05 %02d:%02d:%02d %.1f\n", m, d, int(s / 3600), int(s / 60) % 60, s % 60, r
+    }
+}' > winter.log
+if [ "$(grep -c ' -1.0$' winter.log)" -eq 0 ]; then
+    echo "The generated log has no -1 readings"
+    exit 1
+fi
+
+run() {
+    local ranks=$1
+    shift
+    "$MPIEXEC" "$NP_FLAG" "$ranks" "$@" "$PROGRAM" "${OPTIONS[@]}" > /dev/null || exit 1
+}
+
+OPTIONS=(--input winter.log)
+run 5 "$@"
+mv outputData.log pipeline.log
+
+OPTIONS=(--convert winter.tcol --input winter.log)
+run 1 "$@"
+
+failures=0
+for input in winter.log winter.tcol; do
+    for ranks in 1 3 5 8; do
+        OPTIONS=(--input $input --data-parallel)
+        run $ranks "$@"
+        if ! cmp -s outputData.log pipeline.log; then
+            echo "--data-parallel with $ranks ranks on $input differs from the pipeline"
+            failures=$((failures + 1))
+        fi
+    done
+done
+
+if [ $failures -eq 0 ]; then
+    echo "data-parallel: all cases match the pipeline"
+fi
+[ $failures -eq 0 ]
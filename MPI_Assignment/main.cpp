@@ -2,11 +2,18 @@
 #include <mpi.h>
 #include <sys/time.h>
 #include <iostream>
+#include <cstdlib>
+
+static bool isRankIn(int rank, const vector<int> &ranks) {
+    return find(ranks.begin(), ranks.end(), rank) != ranks.end();
+}
 
 int main(int argc, char *argv[]) {
     struct timeval start, end;
     gettimeofday(&start, NULL); // Start timer
-    MPI_Init(&argc, &argv);
+    // Hybrid mode: stages may run thread teams, but only each rank's main thread calls MPI
+    int threadSupport;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
 
     TemperatureAnalysisMPI analysis;
 
@@ -19,17 +26,100 @@ int main(int argc, char *argv[]) {
     analysis.setHeatingMonths({12, 1, 2, 3});
     analysis.setCoolingMonths({7, 8, 9});
 
-    if (rank == FILEREADER) {
+    // Options:
+    //   --data-parallel     give every rank its own share of the file instead of one pipeline stage
+    //   --batch-bytes N     bytes of input per batch from the reader to the parser
+    //   --adaptive-batch    let the reader tune the batch size while it runs
+    //   --evaluators N      spread months over N evaluator ranks (ranks 3, 4 and 5..N+2); later ranks parse
+    //   --writer-rank       send findings to a writer rank (4) instead of writing them from the evaluators
+    //                       with collective MPI-IO; evaluators are then ranks 3 and 5..N+3
+    //   --threads N         threads per rank for parsing and monthly statistics (hybrid MPI + threads)
+    //   --no-shared-memory  send batches between stages on the same node over MPI instead of shared rings
+    //   --input FILE        read FILE instead of bigw12a.log; a text log, a .gz or .zst of one, or a
+    //                       columnar cache
+    //   --convert FILE      only write the columnar cache of the input to FILE, for later runs to read
+    //   --month-index       let the pipeline reader skip the months that are neither heating nor cooling
+    //                       months, using a sidecar index of the log (FILE.idx, built on first use)
+    bool dataParallel = false;
+    bool sharedMemory = true;
+    string convertTo;
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--data-parallel") {
+            dataParallel = true;
+        } else if (option == "--batch-bytes" && i + 1 < argc) {
+            analysis.setBatchBytes(atoi(argv[++i]));
+        } else if (option == "--adaptive-batch") {
+            analysis.setAdaptiveBatching(true);
+        } else if (option == "--evaluators" && i + 1 < argc) {
+            analysis.setEvaluatorCount(atoi(argv[++i]));
+        } else if (option == "--threads" && i + 1 < argc) {
+            analysis.setThreads(atoi(argv[++i]));
+        } else if (option == "--writer-rank") {
+            analysis.setCollectiveOutput(false);
+        } else if (option == "--no-shared-memory") {
+            sharedMemory = false;
+        } else if (option == "--input" && i + 1 < argc) {
+            inputFile = argv[++i];
+        } else if (option == "--convert" && i + 1 < argc) {
+            convertTo = argv[++i];
+        } else if (option == "--month-index") {
+            analysis.setMonthIndex(true);
+        }
+    }
+
+    // Converting is a one-off sequential pass, done by rank 0 alone
+    if (!convertTo.empty()) {
+        int failed = 0;
+        if (rank == 0) {
+            failed = !convertLogToColumnar(inputFile, convertTo);
+            if (!failed) {
+                printf("Wrote columnar cache %s of %s\n", convertTo.c_str(), inputFile.c_str());
+            }
+        }
+        MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Finalize();
+        return failed;
+    }
+
+    // Every rank has to know whether the reader sends text or cache blocks
+    analysis.setColumnarInput(ColumnarLog::isColumnarFile(inputFile));
+
+    // Ranks cannot start decompressing at their own share of a compressed log, so it goes through the pipeline
+    if (dataParallel && CompressedReader::detect(inputFile) != COMPRESSION_NONE) {
+        if (rank == 0) {
+            printf("%s is compressed; reading it with the pipeline instead of --data-parallel\n", inputFile.c_str());
+        }
+        dataParallel = false;
+    }
+
+    if (threadSupport < MPI_THREAD_FUNNELED) {
+        if (rank == 0) {
+            printf("MPI library without MPI_THREAD_FUNNELED support, using one thread per rank\n");
+        }
+        analysis.setThreads(1);
+    }
+
+    // Pipeline stages placed on the same node hand batches over through shared memory
+    if (!dataParallel && sharedMemory) {
+        analysis.setupSharedLinks();
+    }
+
+    if (dataParallel) {
+        analysis.dataParallel(inputFile, outputFile);
+    } else if (rank == FILEREADER) {
         analysis.fileReader(inputFile);
-    } else if (rank == PARSER) {
+    } else if (isRankIn(rank, analysis.parserRanks())) {
         analysis.parser();
     } else if (rank == ANOMALYDETECTOR) {
         analysis.anomalyDetector(); 
-    } else if (rank == EVALUATETEMPERATURES) {
-        analysis.evaluateMonthlyTemperatures();
+    } else if (isRankIn(rank, analysis.evaluatorRanks())) {
+        analysis.evaluateMonthlyTemperatures(outputFile);
     } else if (rank == FILEWRITER) {
         analysis.fileWriter(outputFile);
     }
+    analysis.releaseSharedLinks();
+    freeWireRecordType();
 
     MPI_Finalize();
 
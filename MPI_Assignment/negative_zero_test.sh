@@ -0,0 +1,46 @@
+#!/bin/bash
+# Checks that a reading of -0.0 is reported as -0, as the text log has it, although the pipeline
+# sends temperatures in tenths of a degree and the columnar cache stores them that way.
+# usage: negative_zero_test.sh <program> <mpiexec> <numproc flag> [mpiexec flags...]
+PROGRAM=$(realpath "$1")
+MPIEXEC=$2
+NP_FLAG=$3
+shift 3
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+# February around 5 degrees, falling to -0.0 for the first hour of the 26th
+awk 'BEGIN {
+    srand(2)
+    for (d = 1; d <= 28; d++) for (s = 0; s < 86400; s += 60) {
+        t = 5 + rand() * 0.4
+        if (d == 25 && s >= 82800) t = 5 - (s - 82800) / 600
+        if (d == 26 && s < 3600) t = 0
+        if (d == 26 && s >= 3600 && s < 7200) t = (s - 3600) / 600
+        r = sprintf("%.1f", t < 0 ? 0 : t)
+        if (r == "0.0") r = "-0.0"
+        printf "02/%02d/04 %02d:%02d:%02d %s\n", d, int(s / 3600), int(s / 60) % 60, s % 60, r
+    }
+    print "03/01/04 00:00:00 5.0"
+}' > february.log
+
+EXPECTED="Heating issue detected: 2/26/4 At Hour: 0 | Temp: -0"
+
+"$MPIEXEC" "$NP_FLAG" 1 "$@" "$PROGRAM" --convert february.tcol --input february.log > /dev/null || exit 1
+
+failures=0
+for options in "--input february.log" "--input february.log --data-parallel" \
+               "--input february.tcol" "--input february.tcol --data-parallel"; do
+    "$MPIEXEC" "$NP_FLAG" 5 "$@" "$PROGRAM" $options > /dev/null || exit 1
+    if ! grep -qF "$EXPECTED" outputData.log; then
+        echo "$options does not report: $EXPECTED"
+        failures=$((failures + 1))
+    fi
+done
+
+if [ $failures -eq 0 ]; then
+    echo "negative zero: all cases passed"
+fi
+[ $failures -eq 0 ]
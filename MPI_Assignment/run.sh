@@ -21,11 +21,20 @@ module load intel/2017.1.132 intel-mpi/2017.1.132
 cp main.cpp $SLURM_SCRATCH
 cp TemperatureAnalysisMPI.cpp $SLURM_SCRATCH
 cp TemperatureAnalysisMPI.h $SLURM_SCRATCH
+cp SharedRing.h $SLURM_SCRATCH
+cp -r ../common $SLURM_SCRATCH   # Helpers shared with Assignment_2
 cp bigw12a.log $SLURM_SCRATCH
 
 # Compile the source files into object files
 # Compile and link all the source files in one step
-mpicxx main.cpp TemperatureAnalysisMPI.cpp -o main -std=c++11
+mpicxx -I../common main.cpp TemperatureAnalysisMPI.cpp ../common/LogBatch.cpp ../common/ColumnarLog.cpp ../common/LogIndex.cpp ../common/CompressedReader.cpp -o main -std=c++11 -march=native -pthread -DHAVE_ZLIB -lz
 
 # Run the executable with the number of MPI tasks specified by SLURM
-mpirun -np $SLURM_NTASKS ./main
+# (add --data-parallel to split the file across all tasks instead of running the 5 stage pipeline,
+#  --batch-bytes N or --adaptive-batch to size the reader's batches; batch_sweep.sh compares sizes,
+#  --input bigw12a.tcol to read a columnar cache written once with --convert bigw12a.tcol,
+#  --month-index to read only the heating and cooling months of the text log,
+#  --input bigw12a.log.gz or bigw12a.log.zst to read a compressed log; for .zst also compile with
+#  -DHAVE_ZSTD -lzstd, and compress with several frames so the reader's threads share the work)
+# Each task parses and computes statistics with all the cores it was given
+mpirun -np $SLURM_NTASKS ./main --threads $SLURM_CPUS_PER_TASK
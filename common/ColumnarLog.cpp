@@ -0,0 +1,419 @@
+#include "ColumnarLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Bytes of text decoded at a time while converting
+static const size_t CONVERT_CHUNK_SIZE = 4 * 1024 * 1024;
+
+// Blocks start on 8 byte boundaries
+static const uint64_t COLUMNAR_ALIGNMENT = 8;
+
+// Collects the records of the block being written
+struct BlockBuilder
+{
+    vector<int16_t> tenths;
+    vector<uint8_t> deltas;
+    uint32_t firstTimestamp;
+    uint32_t previous;
+
+    void clear()
+    {
+        tenths.clear();
+        deltas.clear();
+    }
+
+    void add(uint32_t timestamp, int16_t value)
+    {
+        if (tenths.empty())
+        {
+            firstTimestamp = previous = timestamp;
+        }
+        tenths.push_back(value);
+
+        // Zigzag keeps small backward steps (unordered logs) as short as small forward ones
+        int64_t delta = (int64_t)timestamp - (int64_t)previous;
+        uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        while (zigzag >= 0x80)
+        {
+            deltas.push_back((uint8_t)(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        deltas.push_back((uint8_t)zigzag);
+        previous = timestamp;
+    }
+};
+
+// Writes the builder's block at the current end of the file and records it in the directory
+static void writeBlock(ofstream &out, BlockBuilder &builder, uint64_t &position, vector<ColumnarBlock> &directory)
+{
+    ColumnarBlock block;
+    memset(&block, 0, sizeof(block));
+    block.offset = position;
+    block.count = builder.tenths.size();
+    block.timestampBytes = builder.deltas.size();
+    block.firstTimestamp = builder.firstTimestamp;
+    directory.push_back(block);
+
+    out.write((const char *)builder.tenths.data(), builder.tenths.size() * sizeof(int16_t));
+    out.write((const char *)builder.deltas.data(), builder.deltas.size());
+    position += builder.tenths.size() * sizeof(int16_t) + builder.deltas.size();
+
+    static const char padding[COLUMNAR_ALIGNMENT] = {0};
+    uint64_t pad = (COLUMNAR_ALIGNMENT - position % COLUMNAR_ALIGNMENT) % COLUMNAR_ALIGNMENT;
+    out.write(padding, pad);
+    position += pad;
+    builder.clear();
+}
+
+bool convertLogToColumnar(const string &textLog, const string &columnarFile)
+{
+    ifstream in(textLog, ios::binary);
+    struct stat info;
+    if (!in.is_open() || stat(textLog.c_str(), &info) != 0)
+    {
+        cerr << "Error opening file: " << textLog << endl;
+        return false;
+    }
+    ofstream out(columnarFile, ios::binary | ios::trunc);
+    if (!out.is_open())
+    {
+        cerr << "Error creating file: " << columnarFile << endl;
+        return false;
+    }
+
+    ColumnarHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLUMNAR_MAGIC, sizeof(header.magic));
+    header.byteOrder = COLUMNAR_BYTE_ORDER;
+    header.version = COLUMNAR_VERSION;
+    header.blockRecords = COLUMNAR_BLOCK_RECORDS;
+    out.write((const char *)&header, sizeof(header)); // Rewritten with the totals at the end
+    uint64_t position = sizeof(header);
+
+    vector<ColumnarBlock> directory;
+    map<pair<int, int>, pair<uint32_t, uint32_t>> monthBlocks; // (year, month) -> first and last block
+    BlockBuilder builder;
+    LogBatch batch;
+    vector<char> buffer(CONVERT_CHUNK_SIZE);
+    size_t carried = 0;    // Bytes of an unfinished line at the front of the buffer
+    uint64_t textBytes = 0; // Bytes of the log read so far
+    uint32_t currentDay = UINT32_MAX;
+    int year = 0, month = 0, day;
+    bool ok = true;
+
+    while (ok)
+    {
+        if (carried == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2); // A single line longer than the buffer
+        }
+        in.read(buffer.data() + carried, buffer.size() - carried);
+        size_t filled = carried + in.gcount();
+        bool atEnd = (size_t)in.gcount() < buffer.size() - carried;
+        textBytes += in.gcount();
+
+        // A read that stops early must be the end of the log, not an I/O error or a log that shrank
+        if (atEnd && (in.bad() || textBytes != (uint64_t)info.st_size))
+        {
+            cerr << "Error reading file: " << textLog << " (read " << textBytes << " of " << info.st_size
+                 << " bytes), no columnar cache written" << endl;
+            ok = false;
+            break;
+        }
+
+        // Decode whole lines only, unless this is the end of the log
+        size_t whole = filled;
+        if (!atEnd)
+        {
+            const char *lastBreak = (const char *)memrchr(buffer.data(), '\n', filled);
+            whole = (lastBreak == NULL) ? 0 : lastBreak + 1 - buffer.data();
+        }
+
+        batch.clear();
+        parseLogBlock(buffer.data(), whole, batch);
+        header.malformed += batch.malformed;
+
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            double temperature = batch.temperatures[i];
+            int16_t tenths;
+            if (!temperatureToTenths(temperature, tenths))
+            {
+                cerr << "Cannot store temperature " << temperature << " of " << textLog
+                     << " in tenths of a degree, no columnar cache written" << endl;
+                ok = false;
+                break;
+            }
+
+            uint32_t timestamp = batch.timestamps[i];
+            if (timestamp / 86400u != currentDay)
+            {
+                currentDay = timestamp / 86400u;
+                logCivilFromDays(currentDay, year, month, day);
+            }
+            uint32_t blockIndex = directory.size();
+            auto entry = monthBlocks.insert(make_pair(make_pair(year, month), make_pair(blockIndex, blockIndex))).first;
+            entry->second.second = blockIndex;
+
+            builder.add(timestamp, tenths);
+            header.records++;
+            if (builder.tenths.size() == COLUMNAR_BLOCK_RECORDS)
+            {
+                writeBlock(out, builder, position, directory);
+            }
+        }
+
+        carried = filled - whole;
+        memmove(buffer.data(), buffer.data() + whole, carried);
+        if (atEnd)
+        {
+            break;
+        }
+    }
+
+    if (ok)
+    {
+        if (!builder.tenths.empty())
+        {
+            writeBlock(out, builder, position, directory);
+        }
+
+        header.blockCount = directory.size();
+        header.blocksOffset = position;
+        out.write((const char *)directory.data(), directory.size() * sizeof(ColumnarBlock));
+        position += directory.size() * sizeof(ColumnarBlock);
+
+        vector<ColumnarMonth> index;
+        for (const auto &entry : monthBlocks)
+        {
+            index.push_back({entry.first.first, entry.first.second, entry.second.first, entry.second.second});
+        }
+        header.monthCount = index.size();
+        header.monthsOffset = position;
+        out.write((const char *)index.data(), index.size() * sizeof(ColumnarMonth));
+
+        out.seekp(0);
+        out.write((const char *)&header, sizeof(header));
+        out.close();
+        ok = !out.fail();
+        if (!ok)
+        {
+            cerr << "Error writing file: " << columnarFile << endl;
+        }
+    }
+
+    if (!ok)
+    {
+        out.close();
+        remove(columnarFile.c_str());
+    }
+    return ok;
+}
+
+bool decodeColumnarBlock(const ColumnarBlock &block, const char *data, LogBatch &batch)
+{
+    size_t base = batch.timestamps.size();
+    batch.timestamps.resize(base + block.count);
+    batch.temperatures.resize(base + block.count);
+    uint32_t *timestamps = batch.timestamps.data() + base;
+    double *temperatures = batch.temperatures.data() + base;
+
+    // Every reading comes back bit for bit, -0.0 included (see tenthsToTemperature). The column is
+    // read with memcpy because a block received in an MPI buffer need not be aligned.
+    for (uint32_t i = 0; i < block.count; ++i)
+    {
+        int16_t tenths;
+        memcpy(&tenths, data + i * sizeof(int16_t), sizeof(tenths));
+        temperatures[i] = tenthsToTemperature(tenths);
+    }
+
+    const uint8_t *cursor = (const uint8_t *)data + block.count * sizeof(int16_t);
+    const uint8_t *end = cursor + block.timestampBytes;
+    uint32_t timestamp = block.firstTimestamp;
+    for (uint32_t i = 0; i < block.count; ++i)
+    {
+        uint64_t zigzag;
+        if (cursor < end && *cursor < 0x80)
+        {
+            zigzag = *cursor++; // Regularly spaced readings take one byte each
+        }
+        else
+        {
+            zigzag = 0;
+            for (int shift = 0;; shift += 7)
+            {
+                if (cursor == end || shift > 63)
+                {
+                    batch.timestamps.resize(base);
+                    batch.temperatures.resize(base);
+                    return false;
+                }
+                uint8_t byte = *cursor++;
+                zigzag |= (uint64_t)(byte & 0x7f) << shift;
+                if (byte < 0x80)
+                {
+                    break;
+                }
+            }
+        }
+        timestamp += (uint32_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+        timestamps[i] = timestamp;
+    }
+    return true;
+}
+
+ColumnarLog::ColumnarLog() : fd(-1), mapping(NULL), length(0) {}
+
+ColumnarLog::~ColumnarLog()
+{
+    close();
+}
+
+bool ColumnarLog::isColumnarFile(const string &filename)
+{
+    char magic[sizeof(COLUMNAR_MAGIC)];
+    ifstream in(filename, ios::binary);
+    return in.read(magic, sizeof(magic)) && memcmp(magic, COLUMNAR_MAGIC, sizeof(magic)) == 0;
+}
+
+bool ColumnarLog::open(const string &filename)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        cerr << "Error opening file: " << filename << endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ColumnarHeader))
+    {
+        cerr << "Not a valid columnar cache: " << filename << endl;
+        close();
+        return false;
+    }
+
+    void *address = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED)
+    {
+        cerr << "Error mapping file: " << filename << endl;
+        close();
+        return false;
+    }
+    mapping = static_cast<const char *>(address);
+    length = info.st_size;
+
+    // Check everything the decoder relies on once, so blocks can be decoded without further checks
+    const ColumnarHeader &head = header();
+    if (memcmp(head.magic, COLUMNAR_MAGIC, sizeof(head.magic)) == 0 && head.byteOrder == __builtin_bswap32(COLUMNAR_BYTE_ORDER))
+    {
+        cerr << "Columnar cache written on a host of the other byte order: " << filename
+             << "; convert the log again on this host" << endl;
+        close();
+        return false;
+    }
+    bool valid = memcmp(head.magic, COLUMNAR_MAGIC, sizeof(head.magic)) == 0 && head.version == COLUMNAR_VERSION &&
+                 head.blocksOffset <= length && head.blockCount <= (length - head.blocksOffset) / sizeof(ColumnarBlock) &&
+                 head.monthsOffset <= length && head.monthCount <= (length - head.monthsOffset) / sizeof(ColumnarMonth);
+    if (valid)
+    {
+        blocks.resize(head.blockCount);
+        memcpy(blocks.data(), mapping + head.blocksOffset, blocks.size() * sizeof(ColumnarBlock));
+        months.resize(head.monthCount);
+        memcpy(months.data(), mapping + head.monthsOffset, months.size() * sizeof(ColumnarMonth));
+
+        uint64_t records = 0;
+        for (const ColumnarBlock &block : blocks)
+        {
+            valid = valid && block.offset % COLUMNAR_ALIGNMENT == 0 && block.offset <= head.blocksOffset &&
+                    (uint64_t)block.count * sizeof(int16_t) + block.timestampBytes <= head.blocksOffset - block.offset;
+            records += block.count;
+        }
+        for (const ColumnarMonth &month : months)
+        {
+            valid = valid && month.firstBlock <= month.lastBlock && month.lastBlock < blocks.size();
+        }
+        valid = valid && records == head.records;
+    }
+
+    if (!valid)
+    {
+        cerr << "Not a valid columnar cache: " << filename << endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ColumnarLog::close()
+{
+    blocks.clear();
+    months.clear();
+    if (mapping != NULL)
+    {
+        munmap(const_cast<char *>(mapping), length);
+        mapping = NULL;
+        length = 0;
+    }
+
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool ColumnarLog::decodeBlock(size_t i, LogBatch &batch) const
+{
+    return decodeColumnarBlock(blocks[i], mapping + blocks[i].offset, batch);
+}
+
+void ColumnarLog::selectBlocks(const vector<int> &wanted, vector<char> &selected) const
+{
+    selected.assign(blocks.size(), 0);
+    for (const ColumnarMonth &month : months)
+    {
+        if (find(wanted.begin(), wanted.end(), month.month) != wanted.end())
+        {
+            fill(selected.begin() + month.firstBlock, selected.begin() + month.lastBlock + 1, 1);
+        }
+    }
+}
+
+size_t ColumnarLog::spanBytes(size_t first, size_t last) const
+{
+    if (first >= last)
+    {
+        return 0;
+    }
+    const ColumnarBlock &end = blocks[last - 1];
+    return end.offset + end.count * sizeof(int16_t) + end.timestampBytes - blocks[first].offset;
+}
+
+void ColumnarLog::adviseSequential(size_t first, size_t last) const
+{
+    if (mapping == NULL || first >= last)
+    {
+        return;
+    }
+
+    // madvise needs a page aligned address, so round the start down
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t offset = blocks[first].offset;
+    size_t alignedOffset = offset - (offset % pageSize);
+    madvise(const_cast<char *>(mapping) + alignedOffset, spanBytes(first, last) + (offset - alignedOffset), MADV_SEQUENTIAL);
+}
@@ -0,0 +1,171 @@
+#ifndef COLUMNAR_LOG_H
+#define COLUMNAR_LOG_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "LogBatch.h"
+
+using namespace std;
+
+/*
+ * Binary columnar cache of a parsed temperature log, written once by
+ * convertLogToColumnar and then mapped read-only by the engines instead of
+ * parsing the text again. All fields are in the byte order of the host that
+ * wrote the file, recorded in ColumnarHeader::byteOrder; open refuses a cache
+ * written on a host of the other byte order.
+ *
+ *   ColumnarHeader                 at offset 0
+ *   block data                     each block 8 byte aligned:
+ *     int16_t tenths[count]          temperature column, fixed point in tenths of a degree
+ *                                    (TENTHS_NEGATIVE_ZERO for -0.0, see temperatureToTenths)
+ *     uint8_t deltas[...]            timestamp column: zigzag LEB128 varints, each the
+ *                                    difference to the previous timestamp of the block
+ *                                    (the first one to ColumnarBlock::firstTimestamp)
+ *   ColumnarBlock[blockCount]      block directory, at ColumnarHeader::blocksOffset
+ *   ColumnarMonth[monthCount]      month index, at ColumnarHeader::monthsOffset
+ *
+ * Records keep the order of the text log, so an engine that reads the blocks
+ * in order sees exactly the readings it would have parsed.
+ */
+
+// Records per block (the last block of a file may hold fewer)
+static const uint32_t COLUMNAR_BLOCK_RECORDS = 16384;
+
+static const char COLUMNAR_MAGIC[8] = {'T', 'L', 'O', 'G', 'C', 'O', 'L', '1'};
+static const uint32_t COLUMNAR_VERSION = 2;
+
+// Written in host order: reads back as 0x04030201 on a host of the other byte order
+static const uint32_t COLUMNAR_BYTE_ORDER = 0x01020304;
+
+struct ColumnarHeader
+{
+    char magic[8];          // COLUMNAR_MAGIC
+    uint32_t byteOrder;     // COLUMNAR_BYTE_ORDER
+    uint32_t version;       // COLUMNAR_VERSION
+    uint32_t blockRecords;  // Records per full block
+    uint32_t unused;        // Zero; keeps the 64-bit fields aligned
+    uint64_t records;       // Records in the whole file
+    uint64_t malformed;     // Non-blank lines of the text log that failed to parse
+    uint64_t blockCount;
+    uint64_t blocksOffset;  // Position of the block directory
+    uint64_t monthCount;
+    uint64_t monthsOffset;  // Position of the month index
+};
+
+// Directory entry of one block
+struct ColumnarBlock
+{
+    uint64_t offset;         // Position of the block's temperature column
+    uint32_t count;          // Records in the block
+    uint32_t timestampBytes; // Size of the block's timestamp column
+    uint32_t firstTimestamp; // Packed timestamp (see packTimestamp) of the first record
+    uint32_t unused;         // Zero; pads the entry to 8 bytes
+};
+
+// Month index entry: every block holding a reading of the month lies in [firstBlock, lastBlock].
+// Entries are sorted by year, then month.
+struct ColumnarMonth
+{
+    int32_t year;  // YY, as in the log
+    int32_t month;
+    uint32_t firstBlock;
+    uint32_t lastBlock;
+};
+
+/**
+ * Parses a text log and writes it as a columnar cache. Temperatures are stored
+ * in tenths of a degree, so a log holding a reading that does not round-trip
+ * exactly through that (more than one decimal, or beyond +/-3276.7) is refused
+ * rather than cached with different values.
+ * @arg textLog - name of the "MM/DD/YY HH:MM:SS T.T" log
+ * @arg columnarFile - name of the cache to write; removed again if conversion fails,
+ *                     including when the log cannot be read to its end
+ * @retval true if the cache was written, false otherwise (the reason is printed to cerr)
+ */
+bool convertLogToColumnar(const string &textLog, const string &columnarFile);
+
+/**
+ * Appends the records of one block to batch.
+ * @arg block - directory entry of the block
+ * @arg data - first byte of the block's temperature column
+ * @retval false if the timestamp column is corrupt
+ */
+bool decodeColumnarBlock(const ColumnarBlock &block, const char *data, LogBatch &batch);
+
+// Read-only mapping of a columnar cache. Blocks are independent, so any number
+// of threads can decode their own ranges of blocks at the same time.
+class ColumnarLog
+{
+public:
+    ColumnarLog();
+
+    // Unmaps the file if it is still mapped
+    ~ColumnarLog();
+
+    /**
+     * True if the file starts with the columnar magic, so callers can take
+     * either a text log or a cache as input.
+     */
+    static bool isColumnarFile(const string &filename);
+
+    /**
+     * Maps the file and checks its header, directory and month index.
+     * @param filename - name of the cache
+     * @retval true if the file is a valid cache of this host's byte order, false otherwise (printed to cerr)
+     */
+    bool open(const string &filename);
+
+    /**
+     * Unmaps the file and closes its descriptor.
+     */
+    void close();
+
+    /**
+     * Appends the records of block i to batch.
+     * @retval false if the block is corrupt
+     */
+    bool decodeBlock(size_t i, LogBatch &batch) const;
+
+    /**
+     * Flags the blocks holding a reading of any of the given months (1-12),
+     * according to the month index.
+     * @arg months - calendar months of interest, of any year
+     * @arg selected - resized to blockCount(); selected[i] != 0 if block i is needed
+     */
+    void selectBlocks(const vector<int> &months, vector<char> &selected) const;
+
+    /**
+     * Hints the kernel that a range of blocks will be read sequentially.
+     * @param first - first block of the range
+     * @param last - one past the last block of the range
+     */
+    void adviseSequential(size_t first, size_t last) const;
+
+    /**
+     * Bytes from the start of block first to the end of block last - 1. Blocks
+     * are stored back to back, so a range of them is one contiguous span.
+     */
+    size_t spanBytes(size_t first, size_t last) const;
+
+    bool isOpen() const { return mapping != NULL; }
+    const char *data() const { return mapping; }
+    const ColumnarHeader &header() const { return *(const ColumnarHeader *)mapping; }
+    size_t blockCount() const { return blocks.size(); }
+    const ColumnarBlock &block(size_t i) const { return blocks[i]; }
+    uint64_t recordCount() const { return header().records; }
+
+private:
+    // A mapping owns its descriptor, so copying is not allowed
+    ColumnarLog(const ColumnarLog &) = delete;
+    ColumnarLog &operator=(const ColumnarLog &) = delete;
+
+    int fd;
+    const char *mapping;
+    size_t length;
+    vector<ColumnarBlock> blocks;
+    vector<ColumnarMonth> months;
+};
+
+#endif // COLUMNAR_LOG_H
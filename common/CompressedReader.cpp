@@ -0,0 +1,336 @@
+#include "CompressedReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+// Compressed bytes read from the file at a time
+static const size_t INPUT_CHUNK_SIZE = 1 << 20;
+
+// zstd frames with more compressed bytes or more content than this are streamed instead of held whole
+static const size_t MAX_FRAME_INPUT = 64 << 20;
+static const unsigned long long MAX_FRAME_OUTPUT = 256ull << 20;
+
+CompressedReader::CompressedReader()
+    : compression(COMPRESSION_NONE), fd(-1), endOfFile(false), failed(false), blockSize(0), headroom(0),
+      threads(1), consumed(0), streaming(false), betweenFrames(true), stream(NULL) {}
+
+CompressedReader::~CompressedReader()
+{
+    close();
+}
+
+Compression CompressedReader::detect(const string &filename)
+{
+    unsigned char magic[4] = {0};
+    int file = ::open(filename.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return COMPRESSION_NONE;
+    }
+    ssize_t got = read(file, magic, sizeof(magic));
+    ::close(file);
+
+    if (got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+    {
+        return COMPRESSION_GZIP;
+    }
+    if (got == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+    {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+bool CompressedReader::open(const string &filename, size_t blockSize, unsigned threads, size_t headroom)
+{
+    close();
+    compression = detect(filename);
+#ifndef HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP)
+    {
+        cerr << "Cannot read " << filename << ": built without gzip support (HAVE_ZLIB)" << endl;
+        return false;
+    }
+#endif
+#ifndef HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD)
+    {
+        cerr << "Cannot read " << filename << ": built without zstd support (HAVE_ZSTD)" << endl;
+        return false;
+    }
+#endif
+    if (compression == COMPRESSION_NONE)
+    {
+        return false;
+    }
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    this->blockSize = max(blockSize, (size_t)1);
+    this->threads = max(threads, 1u);
+    this->headroom = headroom;
+    endOfFile = false;
+    failed = false;
+    input.clear();
+    consumed = 0;
+
+    // gzip always streams; zstd starts frame by frame and streams only if it meets a frame it cannot hold
+    streaming = (compression == COMPRESSION_GZIP);
+    betweenFrames = true;
+#ifdef HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP)
+    {
+        z_stream *zs = new z_stream();
+        if (inflateInit2(zs, 15 + 16) != Z_OK)
+        {
+            delete zs;
+            close();
+            return false;
+        }
+        stream = zs;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD)
+    {
+        stream = ZSTD_createDStream();
+        ZSTD_initDStream((ZSTD_DStream *)stream);
+    }
+#endif
+    return true;
+}
+
+void CompressedReader::close()
+{
+    // Frames in flight read only their own copies of the input, but must finish before the object goes
+    for (future<string> &frame : frames)
+    {
+        frame.wait();
+    }
+    frames.clear();
+
+#ifdef HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP && stream != NULL)
+    {
+        inflateEnd((z_stream *)stream);
+        delete (z_stream *)stream;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD && stream != NULL)
+    {
+        ZSTD_freeDStream((ZSTD_DStream *)stream);
+    }
+#endif
+    stream = NULL;
+
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+    input.clear();
+    consumed = 0;
+}
+
+// Appends the next chunk of the file to input, dropping what is already decompressed
+bool CompressedReader::fillInput()
+{
+    if (endOfFile)
+    {
+        return false;
+    }
+    if (consumed > 0)
+    {
+        input.erase(0, consumed);
+        consumed = 0;
+    }
+
+    size_t filled = input.size();
+    input.resize(filled + INPUT_CHUNK_SIZE);
+    ssize_t got;
+    do
+    {
+        got = read(fd, &input[filled], INPUT_CHUNK_SIZE);
+    } while (got < 0 && errno == EINTR);
+
+    input.resize(filled + max(got, (ssize_t)0));
+    if (got <= 0)
+    {
+        endOfFile = true;
+        return false;
+    }
+    return true;
+}
+
+bool CompressedReader::fail(const char *message)
+{
+    cerr << "Decompression failed: " << message << endl;
+    failed = true;
+    return false;
+}
+
+// Starts decompressing whole zstd frames until threads of them are in flight. Switches to streaming
+// at a frame whose size is unknown or too large to hold.
+void CompressedReader::startFrames()
+{
+#ifdef HAVE_ZSTD
+    while (!streaming && frames.size() < threads)
+    {
+        const char *frame = input.data() + consumed;
+        size_t available = input.size() - consumed;
+        size_t frameSize = ZSTD_findFrameCompressedSize(frame, available);
+        if (ZSTD_isError(frameSize))
+        {
+            // The frame is not complete in input yet
+            if (available == 0 && endOfFile)
+            {
+                return;
+            }
+            if (available >= MAX_FRAME_INPUT || !fillInput())
+            {
+                streaming = true; // Also reports a truncated last frame
+            }
+            continue;
+        }
+
+        unsigned long long contentSize = ZSTD_getFrameContentSize(frame, frameSize);
+        if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize > MAX_FRAME_OUTPUT)
+        {
+            streaming = true;
+            return;
+        }
+
+        // The task gets its own copy of the frame, so input can move on
+        string compressed(frame, frameSize);
+        consumed += frameSize;
+        size_t room = headroom;
+        frames.push_back(async(threads > 1 ? launch::async : launch::deferred, [compressed, contentSize, room]() {
+            string output(room + contentSize, '\0');
+            size_t got = ZSTD_decompress(&output[room], contentSize, compressed.data(), compressed.size());
+            if (ZSTD_isError(got) || got != contentSize)
+            {
+                throw runtime_error(ZSTD_isError(got) ? ZSTD_getErrorName(got) : "corrupt zstd frame");
+            }
+            return output;
+        }));
+    }
+#endif
+}
+
+bool CompressedReader::next(string &block)
+{
+    if (failed || fd < 0)
+    {
+        return false;
+    }
+
+    while (!streaming || !frames.empty())
+    {
+        startFrames();
+        if (frames.empty())
+        {
+            if (streaming)
+            {
+                break;
+            }
+            return false; // Every frame has been handed out
+        }
+
+        string output;
+        try
+        {
+            output = frames.front().get();
+        }
+        catch (const runtime_error &error)
+        {
+            frames.pop_front();
+            return fail(error.what());
+        }
+        frames.pop_front();
+        if (output.size() > headroom) // Skippable and empty frames hold no data
+        {
+            block.swap(output);
+            return true;
+        }
+    }
+    return nextStreamed(block);
+}
+
+// Decompresses up to blockSize bytes of the stream into a new block
+bool CompressedReader::nextStreamed(string &block)
+{
+    block.resize(headroom + blockSize);
+    size_t produced = 0;
+    while (produced < blockSize)
+    {
+        if (consumed == input.size() && !fillInput())
+        {
+            if (!betweenFrames && produced == 0)
+            {
+                return fail("the file ends in the middle of a frame");
+            }
+            break;
+        }
+
+#ifdef HAVE_ZLIB
+        if (compression == COMPRESSION_GZIP)
+        {
+            z_stream *zs = (z_stream *)stream;
+            zs->next_in = (Bytef *)&input[consumed];
+            zs->avail_in = input.size() - consumed;
+            zs->next_out = (Bytef *)&block[headroom + produced];
+            zs->avail_out = blockSize - produced;
+            int status = inflate(zs, Z_NO_FLUSH);
+            consumed = input.size() - zs->avail_in;
+            produced = blockSize - zs->avail_out;
+            betweenFrames = (status == Z_STREAM_END);
+            if (status == Z_STREAM_END)
+            {
+                inflateReset(zs); // Another member may follow, as pigz and bgzip write them
+            }
+            else if (status != Z_OK && status != Z_BUF_ERROR)
+            {
+                return fail(zs->msg != NULL ? zs->msg : "corrupt gzip data");
+            }
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if (compression == COMPRESSION_ZSTD)
+        {
+            ZSTD_inBuffer in = {input.data(), input.size(), consumed};
+            ZSTD_outBuffer out = {&block[headroom], blockSize, produced};
+            size_t status = ZSTD_decompressStream((ZSTD_DStream *)stream, &out, &in);
+            consumed = in.pos;
+            produced = out.pos;
+            if (ZSTD_isError(status))
+            {
+                return fail(ZSTD_getErrorName(status));
+            }
+            betweenFrames = (status == 0);
+        }
+#endif
+    }
+
+    block.resize(headroom + produced);
+    return produced > 0;
+}
@@ -0,0 +1,99 @@
+#ifndef COMPRESSED_READER_H
+#define COMPRESSED_READER_H
+
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <string>
+
+using namespace std;
+
+// Compression of an input file, recognised by its leading magic bytes
+enum Compression
+{
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP, // .gz: one or more concatenated gzip members
+    COMPRESSION_ZSTD  // .zst: one or more zstd frames
+};
+
+// Streams the decompressed bytes of a gzip or zstd file as a sequence of
+// blocks, so a log can be read straight out of the archive without a scratch
+// copy. Support for each format is compiled in with HAVE_ZLIB and HAVE_ZSTD.
+//
+// zstd files made of several frames (e.g. zstd -T0 --block-size, or
+// independently compressed pieces concatenated) are decompressed a frame per
+// thread, several frames at a time, and handed out in order. gzip members
+// cannot be found without inflating everything before them, so gzip, and zstd
+// frames too large to hold in memory, are decompressed as a single stream.
+class CompressedReader
+{
+public:
+    CompressedReader();
+
+    // Waits for frames still being decompressed and closes the file
+    ~CompressedReader();
+
+    /**
+     * Reads the magic bytes of a file.
+     * @retval COMPRESSION_GZIP or COMPRESSION_ZSTD for a compressed file, COMPRESSION_NONE otherwise
+     */
+    static Compression detect(const string &filename);
+
+    /**
+     * Opens a compressed file.
+     * @param filename - name of the .gz or .zst file
+     * @param blockSize - bytes of decompressed data per block when streaming
+     * @param threads - zstd frames decompressed at the same time; 1 decompresses on the calling thread only
+     * @param headroom - bytes left free in front of the data of every block
+     * @retval false if the file cannot be opened or this build does not support its format
+     */
+    bool open(const string &filename, size_t blockSize, unsigned threads, size_t headroom);
+
+    /**
+     * Swaps the next block of decompressed data into block: headroom bytes,
+     * then at least one byte of data. Blocks end wherever the decompressor
+     * stops, not at line breaks.
+     * @retval false at the end of the data or on a decompression error (printed to cerr)
+     */
+    bool next(string &block);
+
+    /**
+     * Waits for frames still being decompressed and closes the file.
+     */
+    void close();
+
+    Compression format() const { return compression; }
+
+    // False once next() has stopped on a decompression error rather than at the end of the data
+    bool good() const { return !failed; }
+
+private:
+    CompressedReader(const CompressedReader &) = delete;
+    CompressedReader &operator=(const CompressedReader &) = delete;
+
+    bool fillInput();
+    void startFrames();
+    bool nextStreamed(string &block);
+    bool fail(const char *message);
+
+    Compression compression;
+    int fd;
+    bool endOfFile;
+    bool failed;
+    size_t blockSize;
+    size_t headroom;
+    unsigned threads;
+
+    // Compressed bytes read from the file and not yet decompressed: input[consumed, input.size())
+    string input;
+    size_t consumed;
+
+    // Whole zstd frames being decompressed, in file order; each result is headroom bytes and the frame's data
+    deque<future<string>> frames;
+    bool streaming;     // Decompressing input as one stream rather than frame by frame
+    bool betweenFrames; // The stream decoder has finished its last frame or member, so the file may end here
+
+    void *stream; // z_stream or ZSTD_DStream of the streaming decoder
+};
+
+#endif // COMPRESSED_READER_H
@@ -0,0 +1,145 @@
+#include "LogBatch.h"
+
+#include <cstring>
+
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+#if defined(__SSE4_1__)
+/**
+ * Vector fast path for the fixed columns of "MM/DD/YY HH:MM:SS T.T".
+ * One 16 byte load covers columns 0-15: separators are checked with a single
+ * compare, the eleven digits in that window with a saturating range test, and
+ * a shuffle + multiply-add turns digit pairs into the six calendar fields.
+ * Column 16 (the last seconds digit) is read separately.
+ * @retval true if the line was decoded, false to let the scalar parser decide
+ */
+static inline bool decodeFixedColumns(const char *line, const char *end, LogBatch &batch)
+{
+    const int separatorColumns = (1 << 2) | (1 << 5) | (1 << 8) | (1 << 11) | (1 << 14);
+    const int digitColumns = 0xFFFF & ~separatorColumns;
+
+    const __m128i text = _mm_loadu_si128((const __m128i *)line);
+    const __m128i separators = _mm_setr_epi8(0, 0, '/', 0, 0, '/', 0, 0, ' ', 0, 0, ':', 0, 0, ':', 0);
+    const __m128i digits = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+
+    int separatorHits = _mm_movemask_epi8(_mm_cmpeq_epi8(text, separators));
+    int digitHits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits));
+    unsigned lastDigit = (unsigned)(line[16] - '0');
+
+    if ((separatorHits & separatorColumns) != separatorColumns || (digitHits & digitColumns) != digitColumns || lastDigit > 9)
+    {
+        return false;
+    }
+
+    // Gather the digit pairs next to each other and combine them as tens * 10 + ones
+    const __m128i pairs = _mm_setr_epi8(0, 1, 3, 4, 6, 7, 9, 10, 12, 13, 15, -1, -1, -1, -1, -1);
+    const __m128i weights = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 0, 0, 0, 0);
+    __m128i gathered = _mm_insert_epi8(_mm_shuffle_epi8(digits, pairs), (int)lastDigit, 11);
+    __m128i fields = _mm_maddubs_epi16(gathered, weights);
+
+    int month = _mm_extract_epi16(fields, 0);
+    int day = _mm_extract_epi16(fields, 1);
+    int year = _mm_extract_epi16(fields, 2);
+    int hour = _mm_extract_epi16(fields, 3);
+    int minute = _mm_extract_epi16(fields, 4);
+    int second = _mm_extract_epi16(fields, 5);
+
+    // The temperature column has no fixed width, so finish it with the scalar reader
+    const char *cursor = line + 17;
+    while (end > cursor && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+    {
+        --end;
+    }
+    double temperature;
+    if (!parseLogBlanks(cursor, end) || !parseLogTemperature(cursor, end, temperature) || cursor != end ||
+        month < 1 || month > 12 || day < 1 || day > logDaysInMonth(year, month) || hour > 23 || minute > 59 || second > 60)
+    {
+        return false;
+    }
+
+    batch.timestamps.push_back(packTimestamp(year, month, day, hour, minute, second));
+    batch.temperatures.push_back(temperature);
+    return true;
+}
+#endif
+
+// Decodes one line (without its '\n') into batch
+static inline void decodeLine(const char *line, const char *end, LogBatch &batch)
+{
+#if defined(__SSE4_1__)
+    // 17 prefix columns, a blank and at least one temperature digit
+    if (end - line >= 19 && decodeFixedColumns(line, end, batch))
+    {
+        return;
+    }
+#endif
+
+    LogRecord record;
+    ParseStatus status = parseLogLine(line, end - line, record);
+    if (status == PARSE_OK)
+    {
+        batch.timestamps.push_back(packTimestamp(record));
+        batch.temperatures.push_back(record.temperature);
+    }
+    else if (status == PARSE_MALFORMED)
+    {
+        batch.malformed++;
+    }
+}
+
+size_t parseLogBlock(const char *data, size_t length, LogBatch &batch)
+{
+    size_t before = batch.size();
+    const char *end = data + length;
+    const char *lineStart = data;
+    const char *window = data;
+
+    // Find line breaks a vector at a time and decode each line as its break is found
+#if defined(__AVX2__)
+    const __m256i newline = _mm256_set1_epi8('\n');
+    for (; window + 32 <= end; window += 32)
+    {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)window), newline));
+        while (mask != 0)
+        {
+            const char *lineEnd = window + __builtin_ctz(mask);
+            decodeLine(lineStart, lineEnd, batch);
+            lineStart = lineEnd + 1;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; window + 16 <= end; window += 16)
+    {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)window), newline));
+        while (mask != 0)
+        {
+            const char *lineEnd = window + __builtin_ctz(mask);
+            decodeLine(lineStart, lineEnd, batch);
+            lineStart = lineEnd + 1;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // Scalar tail: [lineStart, window) is known to hold no line break
+    const char *scan = window;
+    while (lineStart < end)
+    {
+        const char *newline = (const char *)memchr(scan, '\n', end - scan);
+        const char *lineEnd = (newline == NULL) ? end : newline;
+        decodeLine(lineStart, lineEnd, batch);
+        lineStart = lineEnd + 1;
+        scan = lineStart;
+    }
+
+    return batch.size() - before;
+}
@@ -0,0 +1,57 @@
+#ifndef LOG_BATCH_H
+#define LOG_BATCH_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include "LogParser.h"
+
+using namespace std;
+
+// Column-oriented output of the batch decoder: one packed timestamp
+// (see packTimestamp) and one temperature per accepted record.
+struct LogBatch
+{
+    vector<uint32_t> timestamps;
+    vector<double> temperatures;
+    size_t malformed; // Non-blank lines that failed to parse
+
+    LogBatch() : malformed(0) {}
+
+    size_t size() const { return timestamps.size(); }
+
+    // Empties the columns but keeps their capacity for the next block
+    void clear()
+    {
+        timestamps.clear();
+        temperatures.clear();
+        malformed = 0;
+    }
+
+    // Expands record i back into a LogRecord
+    void get(size_t i, LogRecord &record) const
+    {
+        unpackTimestamp(timestamps[i], record.year, record.month, record.day, record.hour, record.minute, record.second);
+        record.temperature = temperatures[i];
+    }
+};
+
+/**
+ * Decodes every line in a block of raw log bytes and appends the records to
+ * batch. Lines end at '\n'; the end of the block also ends the last line, so
+ * callers should hand over whole lines. Blank lines are skipped and malformed
+ * ones are counted in batch.malformed.
+ *
+ * When compiled with SSE4.1 or newer (e.g. -msse4.2, -mavx2, -march=native) the
+ * fixed-column "MM/DD/YY HH:MM:SS" prefix is validated and converted with one
+ * 16 byte vector load per line, and with AVX2 line breaks are located 32 bytes
+ * at a time. Otherwise a scalar path built on parseLogLine is used.
+ *
+ * @arg data - first byte of the block
+ * @arg length - number of bytes in the block
+ * @arg batch - receives the decoded records
+ * @retval number of records appended
+ */
+size_t parseLogBlock(const char *data, size_t length, LogBatch &batch);
+
+#endif // LOG_BATCH_H
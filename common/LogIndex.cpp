@@ -0,0 +1,210 @@
+#include "LogIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include "LogParser.h"
+
+using namespace std;
+
+// Bytes of the log scanned at a time while building
+static const size_t INDEX_CHUNK_SIZE = 4 * 1024 * 1024;
+
+static const char INDEX_MAGIC[8] = {'T', 'L', 'O', 'G', 'I', 'D', 'X', '1'};
+
+// Sidecar layout (little-endian, as written by the host): this header, then runCount MonthRuns
+struct IndexHeader
+{
+    char magic[8];
+    uint64_t logSize;
+    int64_t logModified;
+    uint64_t runCount;
+};
+
+/**
+ * Reads the "MM/DD/YY" prefix of a line with the same field rules as
+ * parseLogLine, so a line the parser accepts is always filed under its month.
+ * @retval false if the line does not start with a date
+ */
+static bool readDatePrefix(const char *cursor, const char *end, int &year, int &month)
+{
+    int day;
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+    {
+        ++cursor;
+    }
+    bool ok = parseLogField(cursor, end, 2, month) && parseLogSeparator(cursor, end, '/') &&
+              parseLogField(cursor, end, 2, day) && parseLogSeparator(cursor, end, '/') &&
+              parseLogField(cursor, end, 2, year);
+    return ok && month >= 1 && month <= 12;
+}
+
+LogIndex::LogIndex() : size(0), modified(0) {}
+
+string LogIndex::sidecarName(const string &logFile)
+{
+    return logFile + ".idx";
+}
+
+bool LogIndex::fileStamp(const string &filename, uint64_t &size, int64_t &modified)
+{
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+    {
+        return false;
+    }
+    size = info.st_size;
+    modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    return true;
+}
+
+bool LogIndex::build(const string &logFile)
+{
+    monthRuns.clear();
+    ifstream in(logFile, ios::binary);
+    if (!in.is_open() || !fileStamp(logFile, size, modified))
+    {
+        return false;
+    }
+
+    vector<char> buffer(INDEX_CHUNK_SIZE);
+    size_t carried = 0;    // Bytes of an unfinished line at the front of the buffer
+    uint64_t position = 0; // Offset of buffer[0] in the log
+    while (true)
+    {
+        if (carried == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2); // A single line longer than the buffer
+        }
+        in.read(buffer.data() + carried, buffer.size() - carried);
+        size_t filled = carried + in.gcount();
+        bool atEnd = (size_t)in.gcount() < buffer.size() - carried;
+
+        // Only the first few bytes of each line are looked at; the rest is skipped by memchr
+        const char *line = buffer.data();
+        const char *bufferEnd = buffer.data() + filled;
+        while (line < bufferEnd)
+        {
+            const char *lineBreak = (const char *)memchr(line, '\n', bufferEnd - line);
+            if (lineBreak == NULL && !atEnd)
+            {
+                break; // Finish the line with the next read
+            }
+            const char *lineEnd = (lineBreak == NULL) ? bufferEnd : lineBreak + 1;
+
+            int year, month;
+            uint64_t offset = position + (line - buffer.data());
+            if (readDatePrefix(line, lineEnd, year, month))
+            {
+                if (monthRuns.empty() || monthRuns.back().year != year || monthRuns.back().month != month)
+                {
+                    monthRuns.push_back({year, month, offset, offset});
+                }
+            }
+            else if (monthRuns.empty())
+            {
+                monthRuns.push_back({0, 0, offset, offset});
+            }
+            monthRuns.back().end = position + (lineEnd - buffer.data());
+            line = lineEnd;
+        }
+
+        carried = bufferEnd - line;
+        position += line - buffer.data();
+        memmove(buffer.data(), line, carried);
+        if (atEnd)
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+bool LogIndex::load(const string &indexFile, const string &logFile)
+{
+    monthRuns.clear();
+    uint64_t logSize;
+    int64_t logModified;
+    if (!fileStamp(logFile, logSize, logModified))
+    {
+        return false;
+    }
+
+    ifstream in(indexFile, ios::binary);
+    IndexHeader header;
+    if (!in.read((char *)&header, sizeof(header)) || memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header.logSize != logSize || header.logModified != logModified || header.runCount > logSize + 1)
+    {
+        return false;
+    }
+
+    monthRuns.resize(header.runCount);
+    if (!in.read((char *)monthRuns.data(), monthRuns.size() * sizeof(MonthRun)))
+    {
+        monthRuns.clear();
+        return false;
+    }
+    size = logSize;
+    modified = logModified;
+    return true;
+}
+
+bool LogIndex::save(const string &indexFile) const
+{
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.logSize = size;
+    header.logModified = modified;
+    header.runCount = monthRuns.size();
+
+    ofstream out(indexFile, ios::binary | ios::trunc);
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)monthRuns.data(), monthRuns.size() * sizeof(MonthRun));
+    out.close();
+    return !out.fail();
+}
+
+bool LogIndex::loadOrBuild(const string &logFile)
+{
+    string indexFile = sidecarName(logFile);
+    if (load(indexFile, logFile))
+    {
+        return true;
+    }
+    if (!build(logFile))
+    {
+        return false;
+    }
+    save(indexFile); // Without a sidecar the next run just scans again
+    return true;
+}
+
+vector<pair<uint64_t, uint64_t>> LogIndex::rangesFor(const vector<int> &months) const
+{
+    vector<pair<uint64_t, uint64_t>> ranges;
+    const MonthRun *previous = NULL; // Last run that is read
+    bool beforeFirstDate = true;     // The log's first reading seeds the anomaly filters, so it is always read
+    for (const MonthRun &run : monthRuns)
+    {
+        bool wanted = beforeFirstDate || find(months.begin(), months.end(), run.month) != months.end();
+        beforeFirstDate = beforeFirstDate && run.month == 0;
+        if (!wanted)
+        {
+            continue;
+        }
+
+        // Read the skipped stretch too if dropping it would join two runs of one calendar month
+        bool joinsSameMonth = previous != NULL && previous->month == run.month;
+        if (!ranges.empty() && (ranges.back().second == run.begin || joinsSameMonth))
+        {
+            ranges.back().second = run.end;
+        }
+        else
+        {
+            ranges.push_back(make_pair(run.begin, run.end));
+        }
+        previous = &run;
+    }
+    return ranges;
+}
@@ -0,0 +1,92 @@
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Consecutive lines of a text log whose date falls in one month. Lines
+// without a readable date (blank or malformed ones) join the run they are in.
+struct MonthRun
+{
+    int32_t year;    // YY, as packTimestamp uses it
+    int32_t month;   // 1-12, or 0 for unreadable lines at the start of the log
+    uint64_t begin;  // Offset of the run's first line
+    uint64_t end;    // Offset just past the run's last line
+};
+
+/**
+ * Sparse index of a text log: one MonthRun per change of month, so a
+ * chronological log of N months needs N entries however long it is. Built by
+ * a scan that only finds line breaks and reads the "MM/DD/YY" prefix of each
+ * line, and kept next to the log in a sidecar file (see sidecarName) that is
+ * rebuilt when the log's size or modification time changes.
+ *
+ * Engines whose filters drop every reading outside the heating and cooling
+ * months use rangesFor to read only the byte ranges of those months.
+ */
+class LogIndex
+{
+public:
+    LogIndex();
+
+    /**
+     * Name of the sidecar index of a log: the log's name followed by ".idx".
+     */
+    static string sidecarName(const string &logFile);
+
+    /**
+     * Scans the log and indexes its months.
+     * @retval true if the log could be read
+     */
+    bool build(const string &logFile);
+
+    /**
+     * Reads an index written by save.
+     * @arg indexFile - the sidecar
+     * @arg logFile - the log it must describe
+     * @retval false if the sidecar is missing, damaged, or older than the log
+     */
+    bool load(const string &indexFile, const string &logFile);
+
+    /**
+     * Writes the index to a sidecar file.
+     * @retval true if the file was written
+     */
+    bool save(const string &indexFile) const;
+
+    /**
+     * Loads the log's sidecar, or builds the index and writes the sidecar
+     * for the next run when there is no usable one.
+     * @retval true if the index describes the log
+     */
+    bool loadOrBuild(const string &logFile);
+
+    /**
+     * Byte ranges holding every line of the given months, merged and in file
+     * order, for engines that act on every change of month and on the first
+     * reading of the log to see what they would see reading it all: the runs
+     * up to the log's first dated line are always included, and a skipped
+     * stretch between two runs of the same calendar month is kept so the runs
+     * never join.
+     * @arg months - calendar months of interest (1-12), of any year
+     */
+    vector<pair<uint64_t, uint64_t>> rangesFor(const vector<int> &months) const;
+
+    const vector<MonthRun> &runs() const { return monthRuns; }
+    uint64_t logSize() const { return size; }
+
+private:
+    // Size and modification time of a file, which the sidecar records to detect a changed log
+    static bool fileStamp(const string &filename, uint64_t &size, int64_t &modified);
+
+    vector<MonthRun> monthRuns;
+    uint64_t size;
+    int64_t modified;
+};
+
+#endif // LOG_INDEX_H
@@ -0,0 +1,277 @@
+#ifndef LOG_PARSER_H
+#define LOG_PARSER_H
+
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+// Fields of one "MM/DD/YY HH:MM:SS T.T" log record
+struct LogRecord
+{
+    int month, day, year, hour, minute, second;
+    double temperature;
+};
+
+// Result of parsing one line
+enum ParseStatus
+{
+    PARSE_OK,        // All fields were read and are in range
+    PARSE_EMPTY,     // Blank line (only whitespace or a carriage return)
+    PARSE_MALFORMED  // Anything else, e.g. a truncated or corrupted record
+};
+
+/**
+ * Reads an unsigned decimal field of 1 to maxDigits digits.
+ * @arg cursor - advanced past the digits on success
+ * @arg end - one past the last character of the line
+ * @arg maxDigits - longest field accepted
+ * @arg value - parsed number
+ * @retval true if at least one digit was read
+ */
+inline bool parseLogField(const char *&cursor, const char *end, int maxDigits, int &value)
+{
+    int digits = 0;
+    value = 0;
+    while (cursor < end && digits < maxDigits && (unsigned)(*cursor - '0') < 10)
+    {
+        value = value * 10 + (*cursor - '0');
+        ++cursor;
+        ++digits;
+    }
+    return digits > 0;
+}
+
+/**
+ * Consumes the expected separator character.
+ * @retval true if the next character was the separator
+ */
+inline bool parseLogSeparator(const char *&cursor, const char *end, char separator)
+{
+    if (cursor < end && *cursor == separator)
+    {
+        ++cursor;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Consumes a run of spaces or tabs.
+ * @retval true if at least one blank was skipped
+ */
+inline bool parseLogBlanks(const char *&cursor, const char *end)
+{
+    const char *start = cursor;
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+    {
+        ++cursor;
+    }
+    return cursor != start;
+}
+
+/**
+ * Reads a decimal temperature such as "81.7" or "-3.25" without going
+ * through the locale-aware stream or strtod machinery.
+ * @retval true if a number with at least one digit was read
+ */
+inline bool parseLogTemperature(const char *&cursor, const char *end, double &temperature)
+{
+    static const double scale[] = {1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0};
+
+    bool negative = false;
+    if (cursor < end && (*cursor == '-' || *cursor == '+'))
+    {
+        negative = (*cursor == '-');
+        ++cursor;
+    }
+
+    long long mantissa = 0;
+    int digits = 0;
+    while (cursor < end && (unsigned)(*cursor - '0') < 10 && digits < 12)
+    {
+        mantissa = mantissa * 10 + (*cursor - '0');
+        ++cursor;
+        ++digits;
+    }
+
+    int fractionDigits = 0;
+    if (cursor < end && *cursor == '.')
+    {
+        ++cursor;
+        while (cursor < end && (unsigned)(*cursor - '0') < 10 && fractionDigits < 6)
+        {
+            mantissa = mantissa * 10 + (*cursor - '0');
+            ++cursor;
+            ++fractionDigits;
+        }
+    }
+
+    if (digits + fractionDigits == 0)
+    {
+        return false;
+    }
+
+    // A single correctly rounded division keeps e.g. 817 / 10 == 81.7 exactly as strtod would
+    temperature = (double)mantissa / scale[fractionDigits];
+    if (negative)
+    {
+        temperature = -temperature;
+    }
+    return true;
+}
+
+/**
+ * Number of days in a month (1 to 12) of a YY year, counting 2000 and every
+ * fourth year after it as leap years.
+ */
+inline int logDaysInMonth(int year, int month)
+{
+    static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return (month == 2 && year % 4 == 0) ? 29 : days[month - 1];
+}
+
+/**
+ * Parses one "MM/DD/YY HH:MM:SS T.T" record. Works on a span so callers can
+ * parse straight out of a file buffer; nothing is allocated and no exceptions
+ * are thrown. Trailing blanks and a Windows carriage return are ignored.
+ * The year is the two digit YY; a four digit year is malformed like any
+ * other oversized field, since it could not be told apart from YY later.
+ * A day the month does not have (e.g. 02/30 or 04/31) is malformed too.
+ * @arg line - first character of the record
+ * @arg length - number of characters, excluding the newline
+ * @arg record - filled in when PARSE_OK is returned
+ * @retval PARSE_OK, PARSE_EMPTY for blank lines, PARSE_MALFORMED otherwise
+ */
+inline ParseStatus parseLogLine(const char *line, size_t length, LogRecord &record)
+{
+    const char *cursor = line;
+    const char *end = line + length;
+
+    // Trim trailing whitespace (including the '\r' of CRLF logs)
+    while (end > cursor && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+    {
+        --end;
+    }
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+    {
+        ++cursor;
+    }
+    if (cursor == end)
+    {
+        return PARSE_EMPTY;
+    }
+
+    LogRecord parsed;
+    bool ok = parseLogField(cursor, end, 2, parsed.month) && parseLogSeparator(cursor, end, '/') &&
+              parseLogField(cursor, end, 2, parsed.day) && parseLogSeparator(cursor, end, '/') &&
+              parseLogField(cursor, end, 2, parsed.year) && parseLogBlanks(cursor, end) &&
+              parseLogField(cursor, end, 2, parsed.hour) && parseLogSeparator(cursor, end, ':') &&
+              parseLogField(cursor, end, 2, parsed.minute) && parseLogSeparator(cursor, end, ':') &&
+              parseLogField(cursor, end, 2, parsed.second) && parseLogBlanks(cursor, end) &&
+              parseLogTemperature(cursor, end, parsed.temperature);
+
+    // The whole line must be consumed and every field must be in range
+    if (!ok || cursor != end ||
+        parsed.month < 1 || parsed.month > 12 || parsed.day < 1 || parsed.day > logDaysInMonth(parsed.year, parsed.month) ||
+        parsed.hour > 23 || parsed.minute > 59 || parsed.second > 60)
+    {
+        return PARSE_MALFORMED;
+    }
+
+    record = parsed;
+    return PARSE_OK;
+}
+
+/**
+ * Counts days from 2000-01-01 to the given date (proleptic Gregorian calendar).
+ * @arg year - years since 2000, which is how the two digit YY column reads
+ */
+inline int logDaysFromCivil(int year, int month, int day)
+{
+    year += 2000 - (month <= 2 ? 1 : 0);
+    int era = year / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 730425; // 730425 days from 0000-03-01 to 2000-01-01
+}
+
+/**
+ * Inverse of logDaysFromCivil.
+ */
+inline void logCivilFromDays(int days, int &year, int &month, int &day)
+{
+    days += 730425;
+    int era = days / 146097;
+    int dayOfEra = days - era * 146097;
+    int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int shiftedMonth = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0) - 2000;
+}
+
+/**
+ * Packs a reading's date and time into seconds since 2000-01-01 00:00:00.
+ * Fits in 32 bits for the two digit years the logs use.
+ */
+inline uint32_t packTimestamp(int year, int month, int day, int hour, int minute, int second)
+{
+    return (uint32_t)logDaysFromCivil(year, month, day) * 86400u + hour * 3600u + minute * 60u + second;
+}
+
+inline uint32_t packTimestamp(const LogRecord &record)
+{
+    return packTimestamp(record.year, record.month, record.day, record.hour, record.minute, record.second);
+}
+
+// Tenths value standing for a reading of -0.0, which would otherwise come back as 0. Readings
+// stay within +/-32767 tenths, so this value is otherwise unused.
+const int16_t TENTHS_NEGATIVE_ZERO = INT16_MIN;
+
+/**
+ * Converts a temperature to whole tenths of a degree, the fixed-point form of
+ * the columnar cache and of the MPI wire records. -0.0 becomes
+ * TENTHS_NEGATIVE_ZERO so the report prints it as the text log has it.
+ * @arg temperature - reading as parsed
+ * @arg tenths - the reading times ten
+ * @retval false if the reading has finer precision than tenths or lies outside +/-3276.7
+ */
+inline bool temperatureToTenths(double temperature, int16_t &tenths)
+{
+    if (!(std::fabs(temperature) <= 3276.7))
+    {
+        return false;
+    }
+    long scaled = std::lround(temperature * 10);
+    if (scaled / 10.0 != temperature)
+    {
+        return false;
+    }
+    tenths = (scaled == 0 && std::signbit(temperature)) ? TENTHS_NEGATIVE_ZERO : (int16_t)scaled;
+    return true;
+}
+
+/**
+ * Inverse of temperatureToTenths: the same division the text parser does, so
+ * every reading comes back bit for bit, including the sign of zero.
+ */
+inline double tenthsToTemperature(int16_t tenths)
+{
+    return tenths == TENTHS_NEGATIVE_ZERO ? -0.0 : tenths / 10.0;
+}
+
+/**
+ * Expands a packed timestamp back into calendar fields (year is YY).
+ */
+inline void unpackTimestamp(uint32_t timestamp, int &year, int &month, int &day, int &hour, int &minute, int &second)
+{
+    logCivilFromDays(timestamp / 86400u, year, month, day);
+    uint32_t secondOfDay = timestamp % 86400u;
+    hour = secondOfDay / 3600u;
+    minute = (secondOfDay / 60u) % 60u;
+    second = secondOfDay % 60u;
+}
+
+#endif // LOG_PARSER_H
@@ -0,0 +1,148 @@
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Constant-memory statistics of a stream of readings (Welford's update).
+ * Two accumulators over consecutive or disjoint parts of a stream can be
+ * combined with merge (Chan et al.), so threads and ranks can each summarize
+ * their own share and combine the results afterwards.
+ */
+struct RunningStats
+{
+    long long count;
+    double mean;
+    double m2; // Sum of squared differences from the mean
+    double min;
+    double max;
+
+    RunningStats() : count(0), mean(0.0), m2(0.0), min(INFINITY), max(-INFINITY) {}
+
+    void add(double value)
+    {
+        count++;
+        double delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+
+    void merge(const RunningStats &other)
+    {
+        if (other.count == 0)
+        {
+            return;
+        }
+        if (count == 0)
+        {
+            *this = other;
+            return;
+        }
+
+        long long total = count + other.count;
+        double delta = other.mean - mean;
+        mean += delta * other.count / total;
+        m2 += other.m2 + delta * delta * ((double)count * other.count / total);
+        count = total;
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+    }
+
+    // Population variance (divides by n)
+    double variance() const { return count > 0 ? m2 / count : 0.0; }
+
+    // Sample variance (divides by n - 1)
+    double sampleVariance() const { return count > 1 ? m2 / (count - 1) : 0.0; }
+};
+
+/**
+ * Running maxima and minima of a stream: every reading that was higher (or
+ * lower) than all readings before it, with its position in the stream.
+ *
+ * The first reading above a threshold is always a running maximum (everything
+ * before it was at or below the threshold), and likewise for the first reading
+ * below one, so "first exceedance" questions can be answered once the
+ * threshold is known without keeping the stream. For sensor data the lists
+ * stay short: they only grow when a new high or low is reached.
+ */
+struct ExceedanceCandidates
+{
+    struct Extreme
+    {
+        double value;
+        long long position; // Index of the reading within the stream
+    };
+
+    vector<Extreme> highs; // Strictly increasing values
+    vector<Extreme> lows;  // Strictly decreasing values
+    long long count;       // Readings seen so far
+
+    ExceedanceCandidates() : count(0) {}
+
+    void add(double value)
+    {
+        if (highs.empty() || value > highs.back().value)
+        {
+            highs.push_back({value, count});
+        }
+        if (lows.empty() || value < lows.back().value)
+        {
+            lows.push_back({value, count});
+        }
+        count++;
+    }
+
+    // Appends the candidates of the readings that follow this stream
+    void append(const ExceedanceCandidates &later)
+    {
+        for (const Extreme &extreme : later.highs)
+        {
+            if (highs.empty() || extreme.value > highs.back().value)
+            {
+                highs.push_back({extreme.value, count + extreme.position});
+            }
+        }
+        for (const Extreme &extreme : later.lows)
+        {
+            if (lows.empty() || extreme.value < lows.back().value)
+            {
+                lows.push_back({extreme.value, count + extreme.position});
+            }
+        }
+        count += later.count;
+    }
+
+    // First reading strictly above threshold, or NULL if there is none
+    const Extreme *firstAbove(double threshold) const
+    {
+        for (const Extreme &extreme : highs)
+        {
+            if (extreme.value > threshold)
+            {
+                return &extreme;
+            }
+        }
+        return NULL;
+    }
+
+    // First reading strictly below threshold, or NULL if there is none
+    const Extreme *firstBelow(double threshold) const
+    {
+        for (const Extreme &extreme : lows)
+        {
+            if (extreme.value < threshold)
+            {
+                return &extreme;
+            }
+        }
+        return NULL;
+    }
+};
+
+#endif // RUNNING_STATS_H
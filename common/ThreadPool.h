@@ -0,0 +1,109 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Fixed set of worker threads that run submitted tasks in submission order.
+ * Threads are started once and reused, so short tasks do not pay for thread
+ * creation. The destructor finishes every queued task before joining.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @param threads - number of workers; 0 uses one per hardware thread
+     */
+    explicit ThreadPool(size_t threads = 0) : stopping(false)
+    {
+        if (threads == 0)
+        {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threads; ++i)
+        {
+            workers.push_back(thread(&ThreadPool::work, this));
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(taskMutex);
+            stopping = true;
+        }
+        taskCond.notify_all();
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    size_t size() const { return workers.size(); }
+
+    /**
+     * Queues a task for the next free worker.
+     * @arg task - callable without arguments; bind any arguments (moving large ones in) before submitting
+     * @retval future holding the task's result
+     */
+    template <typename Task>
+    future<typename result_of<Task()>::type> submit(Task task)
+    {
+        typedef typename result_of<Task()>::type Result;
+
+        // packaged_task is move-only, std::function needs a copyable target, so share it
+        shared_ptr<packaged_task<Result()>> packaged = make_shared<packaged_task<Result()>>(move(task));
+        future<Result> result = packaged->get_future();
+        {
+            lock_guard<mutex> lock(taskMutex);
+            tasks.push([packaged]
+                       { (*packaged)(); });
+        }
+        taskCond.notify_one();
+        return result;
+    }
+
+private:
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void work()
+    {
+        while (true)
+        {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(taskMutex);
+                taskCond.wait(lock, [this]
+                              { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                {
+                    return; // Stopping and nothing left to run
+                }
+                task = move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+    mutex taskMutex;
+    condition_variable taskCond;
+    bool stopping;
+};
+
+#endif // THREAD_POOL_H